@@ -11,6 +11,7 @@
 */
 #include <cmath>
 #include <float.h>
+#include "detMath.h"
 #define TINY 1e-6f
 
 //------------------------------------------------------------------------------
@@ -280,8 +281,13 @@ vector2::rotate(float angle)
     // rotates this one around P(0,0).
     float sa, ca;
 
+#ifdef PHY2D_DETERMINISTIC
+    sa = det_sin(angle);
+    ca = det_cos(angle);
+#else
     sa = (float) sin(angle);
     ca = (float) cos(angle);
+#endif
 
     // "handmade" multiplication
     vector2 help(ca * this->x - sa * this->y,
@@ -0,0 +1,71 @@
+#ifndef BVH_SPACE_H
+#define BVH_SPACE_H
+
+#include "phy2d.h"
+
+namespace Phy2d
+{
+    /*
+    Bounding volume hierarchy over the geoms' bounding boxes, built with the
+    surface area heuristic (in 2d the half perimeter of a box stands in for
+    its area).
+
+    Adding geoms rebuilds the tree on the next Update. Moved geoms only refit
+    the boxes bottom up; the tree is rebuilt once the refitted boxes grow past
+    'rebuildRatio' times the total box size measured right after the last
+    build. Candidates are tested in the order the geoms were added, so the
+    result is the same as Space's linear scan.
+    */
+    class BVHSpace : public Space
+    {
+    public:
+        BVHSpace(float rebuildRatio = 1.5f);
+
+        virtual bool QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const;
+        virtual bool QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        virtual bool QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        virtual bool QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const;
+        virtual void CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const;
+        virtual bool Update();
+        virtual void Clear();
+
+        /// rebuild the whole tree from the current geom positions
+        void Rebuild();
+        /// sum of the half perimeters of all node boxes, lower is better
+        float GetCost() const;
+        float GetBuildCost() const
+        {
+            return buildCost;
+        }
+        size_t GetNumNodes() const
+        {
+            return nodes.size();
+        }
+    protected:
+        struct Node
+        {
+            bbox2 box;
+            int left, right;    // children, internal nodes only
+            int first, count;   // range in 'order', count > 0 for leaves
+        };
+        enum
+        {
+            MaxLeafSize = 4,
+            NumBins = 16,
+            MaxDepth = 48,
+        };
+        void Build(int node, int begin, int end, int depth);
+        void Refit();
+        /// indices of the geoms whose box overlaps, to context.candidates
+        void GatherBox(const bbox2 &bound, QueryContext &context) const;
+        void GatherRay(const vector2 &from, const vector2 &to, QueryContext &context) const;
+
+        vector<Node> nodes;         // children always come after their parent
+        vector<int> order;          // geom indices, leaves own a range of it
+        vector<vector2> centers;    // geom box centers while building
+        float buildCost;
+        float rebuildRatio;
+    };
+}
+
+#endif//BVH_SPACE_H
@@ -6,153 +6,42 @@
 #include "hgefont.h"
 #include "hgesprite.h"
 #include "hgefont.h"
-#include "mapQuery.h"
-#include "moveObject.h"
-#include "_vector2.h"
+#include "charSim.h"
 
-class CharEntity : public MoveObject
+/// the buttons of the keyboard
+class HgeCharInput : public CharInput
 {
 public:
-
-    void Load()
+    virtual bool IsDown(Button button) const
     {
+        static const int keys[NumButtons] = { HGEK_LEFT, HGEK_RIGHT, HGEK_Z };
         HGE *hge = hgeCreate(HGE_VERSION);
         assert(hge);
-
-        HTEXTURE tex = hge->Texture_Load("zazaka.png");
-        sprite = new hgeSprite(tex, 0, 0, (float)hge->Texture_GetWidth(tex), (float)hge->Texture_GetHeight(tex));
-        pos.set(hge->System_GetState(HGE_SCREENWIDTH) * 0.5f,
-                hge->System_GetState(HGE_SCREENHEIGHT) * 0.5f);
-        velocity.set(0, 0);
-        bGround = true;
-        bJumphold = false;
-        bGrabWall = false;
-        font = 0;
-        radius = 20.0f;
-        gravity.set(0, 980);
+        bool down = hge->Input_GetKeyState(keys[button]);
         hge->Release();
+        return down;
     }
-    virtual void OnFrame(float delta)
+};
+
+/// CharSim with the keyboard as input, and its sprite
+class CharEntity : public CharSim
+{
+public:
+
+    void Load()
     {
         HGE *hge = hgeCreate(HGE_VERSION);
         assert(hge);
-        vector2 force;
-
-        if (hge->Input_GetKeyState(HGEK_LEFT))
-        {
-            force.x -= 200.0f;
-        }
-        if (hge->Input_GetKeyState(HGEK_RIGHT))
-        {
-            force.x += 200.0f;
-        }
-        if (bGround && !bJumphold && hge->Input_GetKeyState(HGEK_Z))
-        {
-            vector2 g = gravity;
-            g.norm();
-            force += -g * (gravity.len() + 100.0f);
-            velocity += vector2(0, -300);
-            // velocity = velocity - collisionNormal * dot_product(collisionNormal, velocity) + collisionNormal * 100 + vector2(0, -250);
-            bGround = false;
-            bJumphold = true;
-        }
-
-        if (bJumphold)
-        {
-            if (hge->Input_GetKeyState(HGEK_Z))
-            {
-                if (!bGround)
-                {
-                    force -= gravity * 0.5f;
-                    // velocity -= gravity * (0.5f * delta);
-                }
-            }
-            else
-                bJumphold = false;
-        }
-        force += gravity;
-        vector2 v1 = velocity + force * delta;
-        vector2 dest;
-        switch(map->QueryMove(this, pos, pos + v1 * delta, dest))
-        {
-        case MapQuery::CT_None:
-
-            bGround = false;
-            break;
-        case MapQuery::CT_Ground:
-            // apply friction
-            // velocity -= collisionNormal * dot_product(velocity, collisionNormal);
-            //dest.y -= 1;
-            bGround = true;
-            break;
-        case MapQuery::CT_Wall:
-            velocity.x = 0;
-            velocity.y = 0;
-            bGround = true;
-            break;
-        }
-        // pos = dest;
-        if (bGround)
-        {
-            vector2 tempForce = force;
-            vector2 friction;
-            float totalForce = 0;
-            vector2 ttforce;
-            float frictionMu = 0.1f;
-            do
-            {
-                ttforce = tempForce;
-                for (vector<Phy2d::CollisionInfo>::iterator ci = this->collisionInfos.begin();
-                    ci != collisionInfos.end(); ++ci)
-                {
-                    // apply N, support force from collision point
-                    float f = -dot_product(ci->normal, tempForce);
-                    if (f > 0)
-                    {
-                        ci->force += f;
-                        totalForce += f;
-                        tempForce += ci->normal * f;
-                        //friction += 
-                        vector2 friction =  -velocity + ci->normal * dot_product(velocity, ci->normal);
-                        friction.norm();
-                        friction *= f * frictionMu;
-                        tempForce += friction;
-                    }
-                }
-            } while(ttforce != tempForce);
-            for (vector<Phy2d::CollisionInfo>::iterator ci = this->collisionInfos.begin();
-                ci != collisionInfos.end(); ++ci)
-            {
-                float depth = ci->depth - 0.005;
-                if (depth > 0)
-                {
-                    if (totalForce > 0 && ci->force < totalForce)
-                        pos += ci->normal * (depth * ci->force / totalForce);
-                    else
-                        pos += ci->normal * depth;
-                }
-
-                velocity = velocity - ci->normal * dot_product(ci->normal, velocity);
-            }
-            force = tempForce;
-
-            //pos += dest - pos - collisionNormal * dot_product(collisionNormal, dest - pos);
-            //pos += collisionNormal * this->radius;
-            // pos = dest;
-
-            // apply Friction
-           
-        }
-
-        velocity += force * delta;
-        pos += velocity * delta;
 
+        HTEXTURE tex = hge->Texture_Load("zazaka.png");
+        sprite = new hgeSprite(tex, 0, 0, (float)hge->Texture_GetWidth(tex), (float)hge->Texture_GetHeight(tex));
+        Init(vector2(hge->System_GetState(HGE_SCREENWIDTH) * 0.5f,
+                     hge->System_GetState(HGE_SCREENHEIGHT) * 0.5f));
+        SetInput(&keys);
+        font = 0;
         hge->Release();
     }
-    virtual void OnCollide()
-    {
-    }
-    void RenderCircle()
+    void RenderCircle(const vector2 &pos)
     {
         HGE *hge = hgeCreate(HGE_VERSION);
         assert(hge);
@@ -170,7 +59,7 @@ public:
         }
         hge->Release();
     }
-    void RenderStatus()
+    void RenderStatus(const vector2 &pos)
     {
         if (!font)
             return;
@@ -206,20 +95,19 @@ public:
         hge->Release();
     }
 
-    void Render()
+    /// @param alpha where the frame's time is between the last two steps, 0 to 1
+    void Render(float alpha = 1.0f)
     {
-        sprite->Render(pos.x - sprite->GetWidth() / 2, pos.y - sprite->GetHeight() / 2);
-        RenderCircle();
-        RenderStatus();
+        vector2 at = GetRenderPosition(alpha);
+        sprite->Render(at.x - sprite->GetWidth() / 2, at.y - sprite->GetHeight() / 2);
+        RenderCircle(at);
+        RenderStatus(at);
     }
 
-    bool bGround;
-    bool bJumphold;
-    bool bGrabWall;
     hgeSprite *sprite;
     hgeFont *font;
-
-    vector2 gravity;
+protected:
+    HgeCharInput keys;
 };
 
 #endif //CHAR_ENTITY_H
@@ -0,0 +1,46 @@
+#ifndef CHAR_INPUT_H
+#define CHAR_INPUT_H
+
+/// the buttons a character is steered with, read by CharSim every step
+class CharInput
+{
+public:
+    enum Button
+    {
+        Left,
+        Right,
+        Jump,
+        NumButtons,
+    };
+    virtual ~CharInput()
+    {
+    }
+    virtual bool IsDown(Button button) const = 0;
+};
+
+/// buttons set from code, for scripted or replayed input
+class CharButtons : public CharInput
+{
+public:
+    CharButtons()
+    {
+        Clear();
+    }
+    virtual bool IsDown(Button button) const
+    {
+        return down[button];
+    }
+    void Set(Button button, bool isDown)
+    {
+        down[button] = isDown;
+    }
+    void Clear()
+    {
+        for (int i = 0; i < NumButtons; i++)
+            down[i] = false;
+    }
+protected:
+    bool down[NumButtons];
+};
+
+#endif//CHAR_INPUT_H
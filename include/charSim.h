@@ -0,0 +1,197 @@
+#ifndef CHAR_SIM_H
+#define CHAR_SIM_H
+
+#include <cassert>
+#include "charInput.h"
+#include "contactSolver.h"
+#include "mapQuery.h"
+#include "moveObject.h"
+#include "rigidBody.h"
+#include "_vector2.h"
+#include "profiler.h"
+
+/**
+The matchman's movement, without rendering or the engine: OnFrame reads
+the buttons from a CharInput and moves through the MapQuery. Standing on a
+geom of a RigidBody, it is carried along with the body.
+*/
+class CharSim : public MoveObject
+{
+public:
+    CharSim() : input(0)
+    {
+        Init(vector2(0, 0));
+    }
+    /// stand still at 'position', the contacts of before are forgotten: their geoms may be gone
+    void Init(const vector2 &position)
+    {
+        pos = position;
+        SavePosition();
+        velocity.set(0, 0);
+        collisionInfos.clear();
+        lastContacts.clear();
+        collisonDepth = 0;
+        Wake();
+        bGround = true;
+        bJumphold = false;
+        bGrabWall = false;
+        radius = 20.0f;
+        gravity.set(0, 980);
+    }
+    void SetInput(const CharInput *input)
+    {
+        this->input = input;
+    }
+    virtual void OnFrame(float delta)
+    {
+        PROFILE_ZONE("CharSim::OnFrame");
+        assert(input && map);
+        bool pressed = input->IsDown(CharInput::Left) || input->IsDown(CharInput::Right) || input->IsDown(CharInput::Jump);
+        if (sleeping)
+        {
+            // standing still on the ground, neither the map nor the solver are needed
+            if (!pressed)
+                return;
+            Wake();
+        }
+        if (bGround)
+        {
+            // ride along with the platform stood on, then its contacts are found where it is now
+            vector2 carry = Phy2d::SupportVelocity(collisionInfos.empty() ? 0 : &collisionInfos[0], collisionInfos.size());
+            if (carry.x != 0 || carry.y != 0)
+            {
+                vector2 dest;
+                map->SweepMove(this, pos, pos + carry * delta, dest);
+                pos = dest;
+            }
+        }
+        vector2 force;
+
+        if (input->IsDown(CharInput::Left))
+        {
+            force.x -= 200.0f;
+        }
+        if (input->IsDown(CharInput::Right))
+        {
+            force.x += 200.0f;
+        }
+        if (bGround && !bJumphold && input->IsDown(CharInput::Jump))
+        {
+            vector2 g = gravity;
+            g.norm();
+            force += -g * (gravity.len() + 100.0f);
+            velocity += vector2(0, -300);
+            // velocity = velocity - collisionNormal * dot_product(collisionNormal, velocity) + collisionNormal * 100 + vector2(0, -250);
+            bGround = false;
+            bJumphold = true;
+        }
+
+        if (bJumphold)
+        {
+            if (input->IsDown(CharInput::Jump))
+            {
+                if (!bGround)
+                {
+                    force -= gravity * 0.5f;
+                    // velocity -= gravity * (0.5f * delta);
+                }
+            }
+            else
+                bJumphold = false;
+        }
+        force += gravity;
+        vector2 v1 = velocity + force * delta;
+        vector2 dest;
+        // the contacts of the last step warm start the solver
+        lastContacts.swap(collisionInfos);
+        switch(map->QueryMove(this, pos, pos + v1 * delta, dest))
+        {
+        case MapQuery::CT_None:
+
+            bGround = false;
+            break;
+        case MapQuery::CT_Ground:
+            // apply friction
+            // velocity -= collisionNormal * dot_product(velocity, collisionNormal);
+            //dest.y -= 1;
+            bGround = true;
+            break;
+        case MapQuery::CT_Wall:
+            velocity.x = 0;
+            velocity.y = 0;
+            bGround = true;
+            break;
+        }
+        // pos = dest;
+        float support = 0;
+        if (bGround)
+        {
+            // support forces from the contacts, starting from those of the last step
+            Phy2d::CollisionInfo *contacts = collisionInfos.empty() ? 0 : &collisionInfos[0];
+            Phy2d::ContactSolver::WarmStart(contacts, collisionInfos.size(),
+                lastContacts.empty() ? 0 : &lastContacts[0], lastContacts.size());
+            vector2 tempForce = force;
+            float totalForce;
+            solver.Solve(contacts, collisionInfos.size(), velocity, tempForce, totalForce);
+            for (vector<Phy2d::CollisionInfo>::iterator ci = this->collisionInfos.begin();
+                ci != collisionInfos.end(); ++ci)
+            {
+                float depth = ci->depth - 0.005;
+                if (depth > 0)
+                {
+                    if (totalForce > 0 && ci->force < totalForce)
+                        pos += ci->normal * (depth * ci->force / totalForce);
+                    else
+                        pos += ci->normal * depth;
+                }
+
+                velocity = velocity - ci->normal * dot_product(ci->normal, velocity);
+            }
+            force = tempForce;
+            support = totalForce;
+
+            //pos += dest - pos - collisionNormal * dot_product(collisionNormal, dest - pos);
+            //pos += collisionNormal * this->radius;
+            // pos = dest;
+
+            // apply Friction
+           
+        }
+
+        velocity += force * delta;
+        // swept, so a fast fall stops on thin geometry instead of passing through it
+        map->SweepMove(this, pos, pos + velocity * delta, dest, &velocity);
+        pos = dest;
+        UpdateSleep(bGround && !bJumphold && !pressed, support);
+    }
+    virtual void OnCollide()
+    {
+    }
+    virtual void HashState(Phy2d::StateHash &hash) const
+    {
+        MoveObject::HashState(hash);
+        hash.Add(gravity);
+        hash.Add(bGround);
+        hash.Add(bJumphold);
+        hash.Add(bGrabWall);
+        // the geoms are left out, their addresses differ from run to run
+        hash.Add(int(collisionInfos.size()));
+        for (vector<Phy2d::CollisionInfo>::const_iterator ci = collisionInfos.begin(); ci != collisionInfos.end(); ++ci)
+        {
+            hash.Add(ci->feature);
+            hash.Add(ci->force);
+        }
+    }
+
+    bool bGround;
+    bool bJumphold;
+    bool bGrabWall;
+
+    vector2 gravity;
+protected:
+    const CharInput *input;
+    Phy2d::ContactSolver solver;
+    vector<Phy2d::CollisionInfo> lastContacts;  // collisionInfos of the step before
+};
+
+#endif//CHAR_SIM_H
@@ -0,0 +1,50 @@
+#ifndef CONTACT_SOLVER_H
+#define CONTACT_SOLVER_H
+
+#include "phy2d.h"
+
+namespace Phy2d
+{
+    /*
+    Support forces of a circle resting on its contacts, by projected Gauss-Seidel.
+
+    Contact i pushes along its normal with CollisionInfo::force, never pulls,
+    and rubs with frictionMu times that against the circle's sliding velocity.
+    Solve visits the contacts in turn and sets each force so that the total no
+    longer pushes into that contact, clamped at 0; a sweep over all contacts is
+    one iteration. It stops when no force changed by more than 'tolerance'
+    times the applied force, or after maxIterations.
+
+    The forces the contacts come in with are the starting point: WarmStart
+    copies them from the contacts of the last step, matched by geom and
+    feature, so a circle resting like it did the step before is solved in one
+    iteration.
+    */
+    class ContactSolver
+    {
+    public:
+        enum
+        {
+            DefaultMaxIterations = 16,
+        };
+        ContactSolver() : frictionMu(0.1f), tolerance(1e-4f), maxIterations(DefaultMaxIterations)
+        {
+        }
+
+        /// the force of every contact that has a match in 'previous', 0 for the others
+        static void WarmStart(CollisionInfo *contacts, size_t count, const CollisionInfo *previous, size_t numPrevious);
+        /**
+        @param velocity the circle's velocity, friction works against its part along each contact
+        @param force    in: applied to the circle (gravity, input), out: with the contact forces added
+        @param total    out: sum of the contact forces
+        @return the iterations run
+        */
+        int Solve(CollisionInfo *contacts, size_t count, const vector2 &velocity, vector2 &force, float &total) const;
+
+        float frictionMu;
+        float tolerance;    // relative to the applied force
+        int maxIterations;
+    };
+}
+
+#endif//CONTACT_SOLVER_H
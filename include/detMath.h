@@ -0,0 +1,57 @@
+#ifndef DET_MATH_H
+#define DET_MATH_H
+
+#include <cmath>
+
+/*
+Trig made of + and * only, for builds with PHY2D_DETERMINISTIC.
+
+The CRT's sin and cos differ between compilers and library versions in the
+last bits, these round the same everywhere as long as the compiler keeps
+float math strict (no x87 excess precision, no fused multiply-add), which is
+what the "deterministic" premake option asks for. About 2e-7 off std::sin
+for the angles of a game.
+*/
+
+/// 'x' moved by a multiple of 2pi into [-pi, pi]
+inline float det_wrap_angle(float x)
+{
+    const float InvTwoPi = 0.159154943f;
+    // 2pi split in two: TwoPiHi has few bits so k * TwoPiHi is exact for any k that matters
+    const float TwoPiHi = 6.28125f;
+    const float TwoPiLo = 0.00193530717958647692f;
+    float k = (float)floor(x * InvTwoPi + 0.5f);
+    return (x - k * TwoPiHi) - k * TwoPiLo;
+}
+
+/// sine of 'x' in [-pi/2, pi/2], taylor series to x^11, the first left out term is below 6e-8
+inline float det_sin_half(float x)
+{
+    float x2 = x * x;
+    return x * (1.0f + x2 * (-1.66666667e-1f + x2 * (8.33333333e-3f + x2 * (-1.98412698e-4f
+        + x2 * (2.75573192e-6f + x2 * -2.50521084e-8f)))));
+}
+
+/// sine of 'x' in radians
+inline float det_sin(float x)
+{
+    const float Pi = 3.14159265f;
+    const float HalfPi = 1.57079633f;
+    x = det_wrap_angle(x);
+    // sin(pi - x) = sin(x)
+    if (x > HalfPi)
+        x = Pi - x;
+    else if (x < -HalfPi)
+        x = -Pi - x;
+    return det_sin_half(x);
+}
+
+/// cosine of 'x' in radians
+inline float det_cos(float x)
+{
+    const float HalfPi = 1.57079633f;
+    // cos(x) = sin(pi/2 - |x|)
+    return det_sin_half(HalfPi - fabs(det_wrap_angle(x)));
+}
+
+#endif//DET_MATH_H
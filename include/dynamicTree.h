@@ -0,0 +1,184 @@
+#ifndef DYNAMIC_TREE_H
+#define DYNAMIC_TREE_H
+
+#include <cassert>
+#include "phy2d.h"
+
+namespace Phy2d
+{
+    /*
+    Incremental AABB tree after Box2D's b2DynamicTree.
+
+    Every proxy is a leaf holding a fattened copy of its box. Moving a proxy
+    whose new box is still inside the fat box does nothing; otherwise the leaf
+    is removed and inserted again with a new fat box, grown in the direction of
+    the move. Inserting and removing keep the tree balanced with AVL style
+    rotations, so both cost O(log n).
+    */
+    class DynamicTree
+    {
+    public:
+        enum
+        {
+            NullNode = -1,
+            StackSize = 128,
+        };
+        /// @param margin fat boxes are grown by this on every side
+        /// @param displacementMultiplier fat boxes are extended by the move times this
+        DynamicTree(float margin = 4.0f, float displacementMultiplier = 2.0f);
+
+        /// create a leaf for 'box', return the proxy id
+        int CreateProxy(const bbox2 &box, int userData);
+        void DestroyProxy(int proxyId);
+        /// return true if the proxy had to be reinserted
+        bool MoveProxy(int proxyId, const bbox2 &box, const vector2 &displacement);
+        void Clear();
+
+        int GetUserData(int proxyId) const
+        {
+            assert(proxyId >= 0 && proxyId < int(nodes.size()));
+            return nodes[proxyId].userData;
+        }
+        const bbox2 &GetFatBox(int proxyId) const
+        {
+            assert(proxyId >= 0 && proxyId < int(nodes.size()));
+            return nodes[proxyId].box;
+        }
+        int GetHeight() const
+        {
+            return root == NullNode ? 0 : nodes[root].height;
+        }
+        int GetProxyCount() const
+        {
+            return proxyCount;
+        }
+
+        /// callback->QueryCallback(int proxyId) is called for every fat box overlapping 'box',
+        /// it returns false to stop the query
+        template <class T>
+        void Query(T *callback, const bbox2 &box) const;
+        /// callback->RayCastCallback(int proxyId, float maxFraction) is called for every fat box
+        /// the segment from 'from' to 'to' passes within maxFraction. It returns the new maxFraction:
+        /// 0 stops the query, a smaller value clips the ray, maxFraction goes on unchanged
+        template <class T>
+        void RayCast(T *callback, const vector2 &from, const vector2 &to) const;
+    protected:
+        struct TreeNode
+        {
+            bool IsLeaf() const
+            {
+                return child1 == NullNode;
+            }
+            bbox2 box;
+            int userData;
+            int parent;     // next free node while in the free list
+            int child1, child2;
+            int height;     // leaf = 0, free node = -1
+        };
+        int AllocateNode();
+        void FreeNode(int node);
+        void InsertLeaf(int leaf);
+        void RemoveLeaf(int leaf);
+        int Balance(int node);
+
+        vector<TreeNode> nodes;
+        int root;
+        int freeList;
+        int proxyCount;
+        float margin;
+        float displacementMultiplier;
+    };
+
+    template <class T>
+    inline void DynamicTree::Query(T *callback, const bbox2 &box) const
+    {
+        int stack[StackSize];
+        int top = 0;
+        stack[top++] = root;
+        while (top > 0)
+        {
+            int nodeId = stack[--top];
+            if (nodeId == NullNode)
+                continue;
+            const TreeNode &node = nodes[nodeId];
+            if (!BoxOverlap(node.box, box))
+                continue;
+            if (node.IsLeaf())
+            {
+                if (!callback->QueryCallback(nodeId))
+                    return;
+            }
+            else
+            {
+                assert(top + 2 <= StackSize);
+                stack[top++] = node.child1;
+                stack[top++] = node.child2;
+            }
+        }
+    }
+
+    template <class T>
+    inline void DynamicTree::RayCast(T *callback, const vector2 &from, const vector2 &to) const
+    {
+        vector2 d = to - from;
+        float maxFraction = 1.0f;
+        int stack[StackSize];
+        int top = 0;
+        stack[top++] = root;
+        while (top > 0)
+        {
+            int nodeId = stack[--top];
+            if (nodeId == NullNode)
+                continue;
+            const TreeNode &node = nodes[nodeId];
+
+            // slab test of the segment clipped to maxFraction
+            float t0 = 0, t1 = maxFraction;
+            if (d.x == 0)
+            {
+                if (from.x < node.box.vmin.x || from.x > node.box.vmax.x)
+                    continue;
+            }
+            else
+            {
+                float ta = (node.box.vmin.x - from.x) / d.x, tb = (node.box.vmax.x - from.x) / d.x;
+                if (ta > tb)
+                    swap(ta, tb);
+                t0 = max(t0, ta);
+                t1 = min(t1, tb);
+            }
+            if (d.y == 0)
+            {
+                if (from.y < node.box.vmin.y || from.y > node.box.vmax.y)
+                    continue;
+            }
+            else
+            {
+                float ta = (node.box.vmin.y - from.y) / d.y, tb = (node.box.vmax.y - from.y) / d.y;
+                if (ta > tb)
+                    swap(ta, tb);
+                t0 = max(t0, ta);
+                t1 = min(t1, tb);
+            }
+            if (t0 > t1)
+                continue;
+
+            if (node.IsLeaf())
+            {
+                float value = callback->RayCastCallback(nodeId, maxFraction);
+                if (value == 0)
+                    return;
+                if (value < maxFraction)
+                    maxFraction = value;
+            }
+            else
+            {
+                assert(top + 2 <= StackSize);
+                stack[top++] = node.child1;
+                stack[top++] = node.child2;
+            }
+        }
+    }
+}
+
+#endif//DYNAMIC_TREE_H
@@ -0,0 +1,56 @@
+#ifndef DYNAMIC_TREE_SPACE_H
+#define DYNAMIC_TREE_SPACE_H
+
+#include "dynamicTree.h"
+
+namespace Phy2d
+{
+    /*
+    Space for worlds with moving geoms (platforms, doors).
+
+    Geoms are kept in a DynamicTree. Instead of scanning every geom's dirty flag
+    the space registers itself with SetSpace and only looks at the geoms that
+    reported a move since the last Update; a geom still inside its fat box costs
+    nothing more. Update never hands geoms over, so
+        while (world.Update())
+            ;
+    returns after a single call. Candidates are tested in the order the geoms
+    were added, so the result is the same as Space's linear scan.
+    */
+    class DynamicTreeSpace : public Space
+    {
+    public:
+        DynamicTreeSpace(float margin = 4.0f, float displacementMultiplier = 2.0f);
+
+        virtual bool QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const;
+        virtual bool QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        virtual bool QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        virtual bool QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const;
+        virtual void CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const;
+        virtual bool Update();
+        virtual void Clear();
+        virtual void OnGeomMoved(GeomPtr geom);
+
+        const DynamicTree &GetTree() const
+        {
+            return tree;
+        }
+        /// number of moved geoms whose fat box had to be rebuilt in the last Update
+        size_t GetNumReinserted() const
+        {
+            return numReinserted;
+        }
+    protected:
+        struct Gather;
+        friend struct Gather;
+        struct Closest;
+        friend struct Closest;
+
+        DynamicTree tree;
+        vector<bbox2> boxes;        // box of geoms[i] when the tree last saw it
+        vector<GeomPtr> moved;      // geoms reported by OnGeomMoved since the last Update
+        size_t numReinserted;
+    };
+}
+
+#endif//DYNAMIC_TREE_SPACE_H
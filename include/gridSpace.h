@@ -0,0 +1,103 @@
+#ifndef GRID_SPACE_H
+#define GRID_SPACE_H
+
+#include <climits>
+#include "phy2d.h"
+
+namespace Phy2d
+{
+    /*
+    Uniform grid of square cells, every geom is put in each cell its bounding
+    box touches.
+
+    bounded mode: the grid covers a fixed area, one bucket per cell
+    hashed mode:  the grid is unbounded, cells are hashed into a fixed number
+                  of buckets, cells sharing a bucket only cost extra bbox tests
+
+    Geoms that stick out of a bounded grid, or would cover too many cells (long
+    spanning segments), go to an overflow list tested by every query.
+    Ray queries walk the cells along the ray (DDA), circle queries visit the
+    cells touched by the swept circle. Candidates are tested in the order the
+    geoms were added, so the result is the same as Space's linear scan.
+    Works best when the cell size is around the size of a typical geom.
+    */
+    class GridSpace : public Space
+    {
+    public:
+        /// bounded grid covering 'area'
+        GridSpace(const bbox2 &area, float cellSize);
+        /// unbounded grid, cells are hashed into 'numBuckets' buckets
+        GridSpace(float cellSize, size_t numBuckets);
+
+        virtual bool QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const;
+        virtual bool QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        virtual bool QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        virtual bool QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const;
+        virtual void CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const;
+        virtual bool Update();
+        virtual void Clear();
+
+        float GetCellSize() const
+        {
+            return cellSize;
+        }
+        bool IsHashed() const
+        {
+            return hashed;
+        }
+        /// geoms covering more cells than this go to the overflow list
+        void SetMaxCellsPerGeom(int maxCells)
+        {
+            maxCellsPerGeom = maxCells;
+        }
+    protected:
+        struct CellRange
+        {
+            int x0, y0, x1, y1;
+            bool overflow;
+        };
+        /// cell of grid coordinate 'c', clamped to +-INT_MAX/2 so far away (or NaN)
+        /// coordinates stay a valid int and cell ranges can still be subtracted
+        static int ToCell(float c)
+        {
+            const float Limit = float(INT_MAX / 2);
+            float cell = floor(c);
+            if (!(cell > -Limit))
+                return -(INT_MAX / 2);
+            if (cell >= Limit)
+                return INT_MAX / 2;
+            return int(cell);
+        }
+        int CellX(float x) const
+        {
+            return ToCell((x - origin.x) * invCellSize);
+        }
+        int CellY(float y) const
+        {
+            return ToCell((y - origin.y) * invCellSize);
+        }
+        size_t GetBucket(int x, int y) const;
+        CellRange GetCellRange(const bbox2 &box) const;
+        bool ClampRange(int &x0, int &y0, int &x1, int &y1) const;
+        void Insert(size_t index);
+        void Remove(size_t index);
+        void GatherCell(int x, int y, vector<size_t> &candidates) const;
+        void GatherRow(int y, int x0, int x1, vector<size_t> &candidates) const;
+        void GatherRay(vector2 from, vector2 to, vector<size_t> &candidates) const;
+        void GatherCircle(float margin, const vector2 &from, const vector2 &to, vector<size_t> &candidates) const;
+        void GatherAll(vector<size_t> &candidates) const;
+
+        bool hashed;
+        float cellSize;
+        float invCellSize;
+        vector2 origin;
+        int width, height;  // bounded mode only
+        int maxCellsPerGeom;
+
+        vector<vector<size_t> > buckets;    // indices into geoms
+        vector<size_t> overflow;
+        vector<CellRange> ranges;           // cells covered by geoms[i]
+    };
+}
+
+#endif//GRID_SPACE_H
@@ -0,0 +1,76 @@
+#ifndef LEVEL_GENERATOR_H
+#define LEVEL_GENERATOR_H
+
+#include <vector>
+#include "phy2d.h"
+
+using namespace std;
+
+/// linear congruential generator, the same numbers on every platform, unlike rand()
+class LevelRandom
+{
+public:
+    explicit LevelRandom(unsigned int seed) : state(seed)
+    {
+    }
+    /// 24 random bits
+    unsigned int Next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+    /// in [0, 1)
+    float Uniform()
+    {
+        return Next() / 16777216.0f;
+    }
+    /// in [lo, hi)
+    float Uniform(float lo, float hi)
+    {
+        return lo + (hi - lo) * Uniform();
+    }
+protected:
+    unsigned int state;
+};
+
+/**
+What GenerateLevel makes. The defaults are the few random platforms and
+arcs of the game's level.
+
+Sizes are half the length of a segment and the radius of an arc, drawn
+evenly between minSize and maxSize when sizeSkew is 1; larger values favor
+small geoms, the size goes with a random number in [0, 1) to that power.
+*/
+struct LevelParams
+{
+    LevelParams();
+    /// resize 'area' around its center to a square holding 'geomsPerSquare' geoms
+    /// per 100 x 100, counting every geom the params make
+    void SetDensity(float geomsPerSquare);
+    size_t GetGeomCount() const;
+
+    unsigned int seed;
+    bbox2 area;                 // the geoms' centers are in here
+    size_t numSegments;
+    size_t numArcs;
+
+    float minSize, maxSize;
+    int sizeSkew;
+    float maxTilt;              // segments lean at most this far from horizontal, pi for any direction
+    float minArcAngle, maxArcAngle; // half the angle an arc covers
+
+    size_t numClusters;         // 0 spreads the geoms evenly
+    float clusterFraction;      // share of the geoms put into the clusters
+    float clusterRadius;        // the clusters get denser toward their middle
+
+    // pathological cases
+    size_t numSpanning;         // segments from one side of the area to the other
+    size_t numNests;            // sets of concentric arcs, each with nestDepth arcs
+    size_t nestDepth;
+};
+
+/// append new geoms made from 'params' to 'out', the caller deletes them.
+/// The same params give the same level everywhere
+void GenerateLevel(const LevelParams &params, vector<Phy2d::GeomPtr> &out);
+
+#endif//LEVEL_GENERATOR_H
@@ -3,34 +3,22 @@
 
 #include "gamestate.h"
 #include "charEntity.h"
-#include "mapQuery.h"
+#include "spaceMap.h"
 //#include "flatland/flatland.hpp"
 #include "phy2d.h"
+#include "simWorld.h"
+#include "profiler.h"
 class hgeFont;
 class hgeSprite;
 const float Pi = acos(-1.0f);
 
-class Map : public MapQuery
+/// SpaceMap drawing its geoms
+class Map : public SpaceMap
 {
 public:
-    Map(Phy2d::Space *_world) : world(_world)
+    Map(Phy2d::Space *_world) : SpaceMap(_world)
     {
     }
-    virtual CollisionType QueryMove(MoveObject *object, const vector2 &from, const vector2 &to, vector2 &suggest)
-    {
-        vector<Phy2d::CollisionInfo> &ci = object->GetCollisionInfo();
-        ci.clear();
-        if (world->CollisionCircle(object->GetRadius(), from, to, ci))
-        {
-            Phy2d::GeomPtr g = world->GetLastCollision();
-            if (g)
-            {
-                g->GetData();
-            }
-            return MapQuery::CT_Ground;
-        }
-        return MapQuery::CT_None;
-    }
     void RenderGeom(Phy2d::GeomPtr g, DWORD color, int iteration, float radius) const
     {
         HGE *hge = hgeCreate(HGE_VERSION);
@@ -148,39 +136,87 @@ public:
 
         HGE *hge = hgeCreate(HGE_VERSION);
         assert(hge);
-        const vector<Phy2d::GeomPtr> &geoms = world->GetGeoms();
+        vector<Phy2d::GeomPtr> geoms;
+        world->CollectGeoms(geoms);
         for (vector<Phy2d::GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
         {
             RenderGeom(*g, 0xffffffff, 1, radius);
         }
         hge->Release();
     }
-    Phy2d::Space *world;
 };
 
 
+/**
+The simulation runs in fixed steps of 1 / tick rate seconds, however long
+the frames are. OnFrame runs as many steps as the elapsed time holds, at
+most maxSubSteps; time beyond that is dropped, the game then slows down
+instead of spending ever more steps on ever longer frames. OnRender draws
+the movers between their last two steps by what is left over.
+*/
 class MainGameState : public GameState
 {
 public:
-    MainGameState() : fnt(0), map(&world)
+    enum
+    {
+        DefaultTickRate = 60,
+        DefaultMaxSubSteps = 5,
+        MaxProfileLines = 40,   // zones shown by the profiler overlay
+    };
+    MainGameState() : fnt(0), stepTime(1.0f / DefaultTickRate), maxSubSteps(DefaultMaxSubSteps), accumulator(0), subSteps(0),
+        stateHash(0), crowdSize(0), numThreads(0), map(&sim.GetSpace())
     {
     }
     virtual void OnEnter();
     virtual void OnLeave();
     virtual void OnFrame();
     virtual void OnRender();
+
+    /// simulation steps per second
+    void SetTickRate(float ticksPerSecond)
+    {
+        assert(ticksPerSecond > 0);
+        stepTime = 1.0f / ticksPerSecond;
+    }
+    void SetMaxSubSteps(int maxSubSteps)
+    {
+        assert(maxSubSteps > 0);
+        this->maxSubSteps = maxSubSteps;
+    }
+    /// AI matchmen added to every level along with the player, see SimWorld::AddCrowd
+    void SetCrowdSize(int crowdSize)
+    {
+        assert(crowdSize >= 0);
+        this->crowdSize = crowdSize;
+    }
+    /// threads the crowd moves on, 0 for one per core
+    void SetNumThreads(int numThreads)
+    {
+        assert(numThreads >= 0);
+        this->numThreads = numThreads;
+    }
 protected:
+#ifdef PROFILER_ENABLED
+    /// the zones of the last frame, indented by depth, with their times
+    void RenderProfile(float x, float y) const;
+#endif
+
     hgeFont *fnt;
 
-    Phy2d::LineSegmentGeom* MainGameState::CreateLineSegment(const vector2 &a, const vector2 &b);
-    Phy2d::ArcGeom* MainGameState::CreateArc(const vector2 &center, const vector2 &arc, float radian);
 
     CharEntity player;
     float land;
-
-    Phy2d::Space world;
+    float stepTime;             // seconds per step
+    int maxSubSteps;            // steps run by one OnFrame at most
+    float accumulator;          // elapsed time not simulated yet, less than stepTime after OnFrame
+    int subSteps;               // steps run by the last OnFrame
+    unsigned int stateHash;     // SimWorld::HashWorld() after the last step
+    Phy2d::QueryStats queryStats;   // space queries of the last OnFrame that stepped
+    int crowdSize;
+    int numThreads;
+
+    SimWorld sim;
     Map map;
-    vector<Phy2d::GeomPtr> geoms;
    // Flatland::Static<Flatland::Terrain> terrain;
 };
 
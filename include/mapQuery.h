@@ -22,5 +22,16 @@ public:
         suggest = to; // move as wish
         return CT_None;
     }
+    /// sweep the object from from towards to, it stops where it first touches the map and
+    /// slides along what it touched
+    /// @param out suggest where the object ends up
+    /// @param in, out velocity if not 0, its part going into every surface touched is removed, like the move's
+    /// @return collision type, CT_None if the way was clear
+    virtual CollisionType SweepMove(MoveObject * /*object*/, const vector2 & /*from*/, const vector2 &to, vector2 &suggest,
+        vector2 * /*velocity*/ = 0)
+    {
+        suggest = to;
+        return CT_None;
+    }
 };
 #endif
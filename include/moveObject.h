@@ -2,18 +2,26 @@
 #define MOVE_OBJECT_H
 
 
+#include <vector>
+#include <cmath>
 #include "phy2d.h"
+#include "stateHash.h"
+#include "mapQuery.h"
+
+using namespace std;
 //////////////////////////////////////////////////////////////////////////
 /**
 MoveObjectһԲ
 Բpos, 뾶Ϊradius
 */
-class MapQuery;
-
 class MoveObject
 {
 public:
-    MoveObject() : map(0), radius(1.0), collisonDepth(0)
+    enum
+    {
+        SleepSteps = 30,    // idle steps in a row before an object falls asleep
+    };
+    MoveObject() : map(0), radius(1.0), collisonDepth(0), sleeping(false), canSleep(true), idleSteps(0), idleSupport(0)
     {
     }
     void SetMapQuery(MapQuery *map)
@@ -24,6 +32,68 @@ public:
     {
         return radius;
     }
+    const vector2 &GetPosition() const
+    {
+        return pos;
+    }
+    const vector2 &GetVelocity() const
+    {
+        return velocity;
+    }
+    /// an impulse from outside, wakes the object
+    void SetVelocity(const vector2 &velocity)
+    {
+        this->velocity = velocity;
+        Wake();
+    }
+    /// remember the position as the one before the next step, for GetRenderPosition
+    void SavePosition()
+    {
+        prevPos = pos;
+    }
+    /// the position 'alpha' of the way from before the last step to now
+    vector2 GetRenderPosition(float alpha) const
+    {
+        return prevPos + (pos - prevPos) * alpha;
+    }
+    /// move the object by 'offset', used to separate overlapping objects. Swept through the
+    /// map, objects pressed against a wall are not pushed through it
+    void Push(const vector2 &offset)
+    {
+        if (map)
+        {
+            vector2 dest;
+            map->SweepMove(this, pos, pos + offset, dest);
+            pos = dest;
+        }
+        else
+            pos += offset;
+        if (offset.len() > SleepDistance())
+            Wake();
+    }
+    /// asleep, OnFrame leaves it where it is without querying the map until Wake
+    bool IsSleeping() const
+    {
+        return sleeping;
+    }
+    /// OnFrame runs in full again, the object has to be idle for SleepSteps again before it sleeps
+    void Wake()
+    {
+        sleeping = false;
+        idleSteps = 0;
+    }
+    /// an object that cannot sleep is woken and stays awake
+    void SetCanSleep(bool canSleep)
+    {
+        this->canSleep = canSleep;
+        if (!canSleep)
+            Wake();
+    }
+    /// how far an idle object may drift and still count as standing still
+    static float SleepDistance()
+    {
+        return 0.5f;
+    }
     vector<Phy2d::CollisionInfo>& GetCollisionInfo()
     {
         return collisionInfos;
@@ -36,14 +106,54 @@ public:
     virtual void OnFrame(float delta) = 0;
     /// called by physics simulator, once every collision, this could happen more than one per frame, or none.
     virtual void OnCollide() = 0;
+    /// add everything OnFrame reads from the last frame, derived classes add their own state
+    virtual void HashState(Phy2d::StateHash &hash) const
+    {
+        hash.Add(pos);
+        hash.Add(velocity);
+        hash.Add(radius);
+        hash.Add(collisonDepth);
+        hash.Add(sleeping);
+        hash.Add(idleSteps);
+        hash.Add(idlePos);
+        hash.Add(idleSupport);
+    }
 protected:
+    /// at the end of OnFrame: 'idle' if nothing but the ground acts on the object, 'support'
+    /// is the ground's force. Falls asleep after SleepSteps idle steps spent within SleepDistance
+    /// of one spot under a support force that changed by less than a hundredth
+    void UpdateSleep(bool idle, float support)
+    {
+        if (canSleep && idle && (pos - idlePos).len() <= SleepDistance() && fabs(support - idleSupport) <= 0.01f * idleSupport)
+        {
+            if (++idleSteps >= SleepSteps)
+            {
+                sleeping = true;
+                velocity.set(0, 0);
+            }
+        }
+        else
+        {
+            idleSteps = 0;
+            idlePos = pos;
+            idleSupport = support;
+        }
+    }
+
     vector2 velocity;
     vector2 pos;
+    vector2 prevPos;    // pos before the last step
     float radius; 
     MapQuery *map;
 
     vector<Phy2d::CollisionInfo> collisionInfos;// һηײĽӴ㷨
     float collisonDepth;
+
+    bool sleeping;
+    bool canSleep;
+    int idleSteps;      // idle steps in a row
+    vector2 idlePos;    // where the idle steps began
+    float idleSupport;  // support force when they began
 };
 
 #endif//MOVE_OBJECT_H
@@ -0,0 +1,195 @@
+#ifndef MOVER_STORE_H
+#define MOVER_STORE_H
+
+#include <vector>
+#include "phy2d.h"
+#include "contactSolver.h"
+#include "rigidBody.h"
+#include "parallelQuery.h"
+#include "stateHash.h"
+#include "charInput.h"
+
+using namespace std;
+
+/**
+Matchmen kept as arrays instead of objects: each member of CharSim is one
+array of the store and entity i is index i of all of them. Step moves all of
+them the way CharSim::OnFrame moves one, in passes over the arrays:
+
+    Think       the AI presses buttons
+    Accelerate  forces from the buttons and gravity, the wanted move; a mover
+                standing on a RigidBody is carried along first
+    Query       one CollisionCircleBatch for every wanted move
+    Move        support forces and friction from the contacts, then the
+                swept move through the level
+    Separate    movers pushed apart, like SimWorld::ResolvePushes; the pushes
+                of every pair are added up and the sum is swept through the
+                level, so a crowd cannot press a mover through a wall
+
+Movers fall asleep like a MoveObject: standing still on the ground without
+buttons for SleepSteps, they are left out of Accelerate, Query and Move
+until their AI presses a button, another mover pushes them or Wake is called.
+
+No virtual call per mover, and the positions the batch reads are already
+laid out as a CircleQueryBatch. With SetParallel, Query, Move and the
+sweeps of Separate run on several threads; every mover only touches its
+own elements there, so the results do not depend on the number of threads.
+
+The support forces come from a ContactSolver like CharSim's, warm started
+from the contacts of the last step; MaxWarmContacts of them are kept per mover.
+The movers of a store push each other but not the MoveObjects of a SimWorld.
+*/
+class MoverStore
+{
+public:
+    enum
+    {
+        MaxSlides = 4,  // like SpaceMap::MaxSlides
+        MaxWarmContacts = 4,
+        SleepSteps = 30,    // like MoveObject::SleepSteps
+    };
+    enum Flag
+    {
+        Ground = 1,
+        JumpHold = 2,
+        Sleeping = 4,
+    };
+
+    MoverStore();
+
+    /// add an AI driven matchman standing still at 'pos', its AI starts from 'seed'. Returns its index
+    size_t Add(const vector2 &pos, float radius, unsigned int seed);
+    void Clear();
+    size_t GetCount() const
+    {
+        return posX.size();
+    }
+
+    /// a slide shorter than this is dropped
+    static const float MinSlide;
+    /// how far an idle mover may drift and still count as standing still, like MoveObject::SleepDistance
+    static const float SleepDistance;
+
+    /// Query and Move run on these threads, 0 runs them on the calling thread
+    void SetParallel(Phy2d::ParallelQuery *parallel)
+    {
+        this->parallel = parallel;
+    }
+    /// movers that cannot sleep are woken and stay awake
+    void SetCanSleep(bool canSleep);
+    void Wake(size_t i)
+    {
+        flags[i] &= ~Sleeping;
+        idleSteps[i] = 0;
+    }
+    /// wake the movers touching any of 'areas', for geoms that moved there
+    void Wake(const bbox2 *areas, size_t count);
+    size_t GetSleepingCount() const;
+    /// one fixed step of 'delta' seconds through the geoms of 'space'
+    void Step(float delta, const Phy2d::Space &space);
+    /// add the state of every mover, in index order
+    void HashState(Phy2d::StateHash &hash) const;
+
+    vector2 GetPosition(size_t i) const
+    {
+        return vector2(posX[i], posY[i]);
+    }
+    /// the position 'alpha' of the way from before the last step to now
+    vector2 GetRenderPosition(size_t i, float alpha) const
+    {
+        return vector2(prevX[i] + (posX[i] - prevX[i]) * alpha, prevY[i] + (posY[i] - prevY[i]) * alpha);
+    }
+    vector2 GetVelocity(size_t i) const
+    {
+        return vector2(velX[i], velY[i]);
+    }
+    float GetRadius(size_t i) const
+    {
+        return radius[i];
+    }
+    bool HasFlag(size_t i, Flag flag) const
+    {
+        return (flags[i] & flag) != 0;
+    }
+    /// what the queries of the last step did
+    const Phy2d::QueryStats &GetStats() const
+    {
+        return stats;
+    }
+protected:
+    bool IsDown(size_t i, CharInput::Button button) const
+    {
+        return (buttons[i] & (1 << button)) != 0;
+    }
+    /// scratch of one slice of Move
+    struct Scratch
+    {
+        vector<Phy2d::CollisionInfo> support;   // contacts of the mover whose forces are solved
+        Phy2d::QueryContext context;            // for the sweeps
+    };
+    struct MoveJob;
+    friend struct MoveJob;
+    struct PushJob;
+    friend struct PushJob;
+
+    void Think();
+    void Accelerate(float delta, const Phy2d::Space &space);
+    void Query(const Phy2d::Space &space);
+    void Move(float delta, const Phy2d::Space &space);
+    /// the second half of CharSim::OnFrame for awake mover k
+    void Move(size_t k, float delta, const Phy2d::Space &space, Scratch &scratch);
+    void Separate(const Phy2d::Space &space);
+    /// add the pushes apart of movers i and j to pushX, pushY if they overlap
+    void Push(size_t i, size_t j);
+    /// move mover i by its summed push, as far as the level lets it
+    void ApplyPush(size_t i, const Phy2d::Space &space, Phy2d::QueryContext &context);
+    /// where a circle sliding from 'from' towards 'to' ends up, see SpaceMap::SweepMove.
+    /// 'velocity', if not 0, loses its part going into every surface hit
+    static vector2 Slide(const Phy2d::Space &space, float radius, const vector2 &from, const vector2 &to,
+        Phy2d::QueryContext &context, vector2 *velocity = 0);
+    static size_t CellHash(int x, int y, size_t numCells)
+    {
+        return (unsigned(x) * 73856093u ^ unsigned(y) * 19349663u) & (numCells - 1);
+    }
+
+    vector2 gravity;
+    Phy2d::ContactSolver solver;
+    Phy2d::ParallelQuery *parallel;
+    bool canSleep;
+    Phy2d::QueryContext context;    // for the sweeps of Accelerate
+
+    // the movers, one element each
+    vector<float> posX, posY;
+    vector<float> prevX, prevY;     // position before the last step
+    vector<float> velX, velY;
+    vector<float> radius;
+    vector<unsigned char> flags;    // of Flag
+    vector<unsigned char> buttons;  // bit 'CharInput::Button' set while it is down
+    vector<unsigned int> aiState;   // random numbers of the AI
+    vector<int> aiTicks;            // steps until the AI picks new buttons
+    vector<int> idleSteps;          // idle steps in a row
+    vector<float> idleX, idleY;     // where the idle steps began
+    vector<float> idleSupport;      // support force when they began
+    vector<Phy2d::CollisionInfo> warm;  // MaxWarmContacts contacts of the last step per mover
+    vector<unsigned char> warmCount;    // how many of them are used
+
+    // scratch of a step, element k belongs to mover awake[k]
+    vector<size_t> awake;
+    vector<float> forceX, forceY;
+    vector<float> fromX, fromY, toX, toY;   // the wanted move
+    vector<float> queryRadius;
+    Phy2d::ContactBuffer contacts;  // contact ranges of the wanted moves
+    vector<Scratch> scratch;        // one per slice of Move and Separate
+    Phy2d::QueryStats stats;
+    // grid of Separate, the movers of cell c are order[cellStart[c]] .. order[cellStart[c + 1] - 1]
+    vector<int> cellX, cellY;       // cell of each mover
+    vector<size_t> cellStart;
+    vector<size_t> cellNext;
+    vector<size_t> order;
+    vector<float> pushX, pushY;     // sum of the pushes of each mover
+private:
+    MoverStore(const MoverStore &);
+    MoverStore &operator = (const MoverStore &);
+};
+
+#endif//MOVER_STORE_H
@@ -0,0 +1,82 @@
+#ifndef PARALLEL_QUERY_H
+#define PARALLEL_QUERY_H
+
+#include "phy2d.h"
+
+namespace Phy2d
+{
+    /// work cut into slices by ParallelQuery::Run, derive from it for work other than the batched queries
+    class ParallelJob
+    {
+    public:
+        virtual ~ParallelJob()
+        {
+        }
+        /// do items [begin, end). The slices run at the same time, 'slice' is below GetNumThreads
+        virtual void Run(size_t begin, size_t end, int slice) = 0;
+    };
+
+    /*
+    Runs batched Space queries on several threads.
+
+    The batch is cut into contiguous slices, one per thread; the calling thread
+    runs the first slice itself. Every slice goes through the space's reentrant
+    batch call into a buffer of its own, and the buffers are joined in slice
+    order afterwards, so the result is the same whatever the thread count.
+    The space must not be changed (AddGeom, Update, moving geoms) while a batch
+    is running. Threads are started once and wait between batches.
+    */
+    class ParallelQuery
+    {
+    public:
+        enum
+        {
+            MaxThreads = 64,
+            MinSliceSize = 32,  // smaller batches use fewer threads
+        };
+        /// @param numThreads threads running a batch, the caller included. 0 uses one per core
+        explicit ParallelQuery(int numThreads = 0);
+        ~ParallelQuery();
+
+        void SetNumThreads(int numThreads);
+        int GetNumThreads() const
+        {
+            return numThreads;
+        }
+        /// number of processors reported by the system, at least 1
+        static int GetNumCores();
+
+        void CollisionCircleBatch(const Space &space, const CircleQueryBatch &batch, ContactBuffer &out);
+        void CollisionRayBatch(const Space &space, const RayQueryBatch &batch, ContactBuffer &out);
+        /// items [0, count) of 'job' in contiguous slices, one per thread; returns when all are done
+        void Run(ParallelJob &job, size_t count);
+
+        struct Worker;
+        friend struct Worker;
+    protected:
+        void Run(size_t count, ContactBuffer &out);
+        /// cut [0, count) into slices and run them, the calling thread runs the first
+        void RunSlices(size_t count);
+        void RunSlice(int slice);
+        void StartWorkers();
+        void StopWorkers();
+
+        int numThreads;
+        vector<Worker *> workers;       // worker i runs slice i + 1
+        vector<ContactBuffer> parts;    // results of each slice
+
+        // the running batch
+        const Space *space;
+        const CircleQueryBatch *circles;
+        const RayQueryBatch *rays;
+        ParallelJob *job;
+        size_t count;
+        size_t sliceSize;
+        int numSlices;
+    private:
+        ParallelQuery(const ParallelQuery &);
+        ParallelQuery &operator = (const ParallelQuery &);
+    };
+}
+
+#endif//PARALLEL_QUERY_H
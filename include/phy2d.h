@@ -5,6 +5,12 @@
 #include "_matrix33.h"
 #include "bbox.h"
 #include <vector>
+#include <algorithm>
+
+// count what the queries do (see QueryStats) in debug builds, premake --profile for release builds
+#if !defined(PHY2D_STATS) && !defined(NDEBUG)
+#define PHY2D_STATS
+#endif
 
 namespace Phy2d
 {
@@ -16,9 +22,41 @@ namespace Phy2d
     Geom ֧ƽơ֧ת
     ʵcircleֱ߶ΡԲ߶εײ
     */
+    /// bounding boxes touch or overlap (borders count as touching)
+    inline bool BoxOverlap(const bbox2 &a, const bbox2 &b)
+    {
+        return !(a.vmax.x < b.vmin.x || a.vmin.x > b.vmax.x ||
+                 a.vmax.y < b.vmin.y || a.vmin.y > b.vmax.y);
+    }
+    /// 'inner' lies completely inside 'outer' (borders included)
+    inline bool BoxContains(const bbox2 &outer, const bbox2 &inner)
+    {
+        return outer.vmin.x <= inner.vmin.x && outer.vmax.x >= inner.vmax.x &&
+               outer.vmin.y <= inner.vmin.y && outer.vmax.y >= inner.vmax.y;
+    }
+    /// bounding box of a move from 'from' to 'to', grown by 'margin' on every side
+    inline bbox2 SweepBox(const vector2 &from, const vector2 &to, float margin)
+    {
+        bbox2 box;
+        box.vmin.set(min(from.x, to.x) - margin, min(from.y, to.y) - margin);
+        box.vmax.set(max(from.x, to.x) + margin, max(from.y, to.y) + margin);
+        return box;
+    }
+    /// LineSegmentGeom/ArcGeom::CollisionCircle report contacts this far beyond the radius
+    const float CircleContactTolerance = 0.005f;
+
+    class Geom;
+
     struct CollisionInfo
     {
-        CollisionInfo() : depth(0.0f), force(0)
+        /// the part of the geom touched, the end points are a and b of a segment, end1 and end2 of an arc
+        enum Feature
+        {
+            Face,
+            FirstEnd,
+            SecondEnd,
+        };
+        CollisionInfo() : depth(0.0f), force(0), geom(0), feature(Face)
         {
 
         }
@@ -28,8 +66,87 @@ namespace Phy2d
         float depth;    // Ӵ 0ʾ>0ʾһα䣬<0
         // ̬ƽĽ
         float force;    // ʵṩ֧
+        // what was touched, to find the contact again the next step
+        Geom *geom;
+        int feature;    // of Feature
+    };
+    /// receives the contacts of a query as they are found. Derive from it to
+    /// handle contacts without storing them
+    class ContactSink
+    {
+    public:
+        virtual ~ContactSink()
+        {
+        }
+        virtual void AddContact(const CollisionInfo &ci) = 0;
+    };
+    /// appends to a vector, for the vector versions of the queries
+    class ContactVector : public ContactSink
+    {
+    public:
+        explicit ContactVector(vector<CollisionInfo> &contacts) : contacts(contacts)
+        {
+        }
+        virtual void AddContact(const CollisionInfo &ci)
+        {
+            contacts.push_back(ci);
+        }
+        size_t GetCount() const
+        {
+            return contacts.size();
+        }
+    protected:
+        vector<CollisionInfo> &contacts;
+    private:
+        ContactVector &operator = (const ContactVector &);
+    };
+    /// writes into an array owned by the caller and never allocates. Contacts
+    /// beyond the capacity are dropped, GetDropped tells how many
+    class ContactArray : public ContactSink
+    {
+    public:
+        ContactArray(CollisionInfo *data, size_t capacity) : data(data), capacity(capacity), count(0), dropped(0)
+        {
+        }
+        virtual void AddContact(const CollisionInfo &ci)
+        {
+            if (count < capacity)
+                data[count++] = ci;
+            else
+                dropped++;
+        }
+        void Clear()
+        {
+            count = 0;
+            dropped = 0;
+        }
+        size_t GetCount() const
+        {
+            return count;
+        }
+        size_t GetCapacity() const
+        {
+            return capacity;
+        }
+        size_t GetDropped() const
+        {
+            return dropped;
+        }
+        const CollisionInfo &operator [] (size_t i) const
+        {
+            assert(i < count);
+            return data[i];
+        }
+    protected:
+        CollisionInfo *data;
+        size_t capacity;
+        size_t count;
+        size_t dropped;
     };
     class RigidBody;
+    class Space;
+    typedef Space* SpacePtr;
+
     class Geom
     {
     public:
@@ -41,7 +158,11 @@ namespace Phy2d
             Space,
         };
         virtual GeomType GetType() const = 0;
-        Geom() : dirty(true)
+        Geom() : body(0), dirty(true), space(0), spaceProxy(-1)
+        {
+        }
+        /// geoms are deleted through GeomPtr
+        virtual ~Geom()
         {
         }
         virtual bool CanGrab() const
@@ -52,16 +173,40 @@ namespace Phy2d
         {
             return 0;
         }
+        /// GetDistance squared, cheaper for geoms that can skip the square root
+        virtual float GetDistanceSquared(const vector2 &point, vector2 &shadow) const
+        {
+            float d = GetDistance(point, shadow);
+            return d * d;
+        }
+        /// move from 'from' to 'to', but may collide at the collide position
+        virtual bool CollisionRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo)
+        {
+            return false;
+        }
         /// move from 'from' to 'to', but may collide at the collide position
-        virtual bool CollisionRay(const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+        virtual bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo)
         {
             return false;
         }
-        // collideinfoһvectorʾܷײ
-        virtual bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+        /// earliest impact of a circle moving from 'from' to 'to': its center is at
+        /// from + (to - from) * fraction when it first touches, 'normal' points away
+        /// from the geom. A circle already touching and moving closer hits at 0
+        virtual bool SweepCircle(float /*radius*/, const vector2 & /*from*/, const vector2 & /*to*/, float & /*fraction*/, vector2 & /*normal*/)
         {
             return false;
         }
+        /// the same, appending the contacts to a vector
+        bool CollisionRay(const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+        {
+            ContactVector sink(collideinfo);
+            return CollisionRay(from, to, sink);
+        }
+        bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+        {
+            ContactVector sink(collideinfo);
+            return CollisionCircle(radius, from, to, sink);
+        }
         const bbox2& GetBBox() const
         {
             return boundingBox;
@@ -75,6 +220,11 @@ namespace Phy2d
             }
             return false;
         }
+        /// moved since the space last took the flag with GetDirty, the flag is left alone
+        bool IsDirty() const
+        {
+            return dirty;
+        }
         void SetData(void *data)
         {
             this->data = data;
@@ -83,6 +233,34 @@ namespace Phy2d
         {
             return this->data;
         }
+        /// a space that indexes this geom by itself, it is told about every move
+        /// @param proxy the space's own handle for this geom
+        void SetSpace(SpacePtr space, int proxy)
+        {
+            this->space = space;
+            this->spaceProxy = proxy;
+        }
+        SpacePtr GetSpace() const
+        {
+            return space;
+        }
+        int GetSpaceProxy() const
+        {
+            return spaceProxy;
+        }
+        /// the body carrying this geom, 0 for a static geom
+        RigidBody *GetBody() const
+        {
+            return body;
+        }
+        /// move the shape by 'offset', the same as setting it again at the new place but without the trig.
+        /// Moves the bounding box and tells the space, geoms override it to move their points first
+        virtual void Translate(const vector2 &offset)
+        {
+            boundingBox.vmin += offset;
+            boundingBox.vmax += offset;
+            Moved();
+        }
         virtual const vector2 &GetVector2(size_t index) const
         {
             return vector2::zero;
@@ -94,20 +272,32 @@ namespace Phy2d
     protected:
         bbox2 boundingBox;
 
-        // transform
+        // transform, set by the body: the shape is where it was added to 'body', moved by toWorld,
+        // which is the body's position plus toParent
         vector2 toParent;
         vector2 toWorld;
 
         RigidBody *body;
+        friend class RigidBody;
         bool dirty; // ƶ
 
         void *data;
+
+        SpacePtr space;
+        int spaceProxy;
+
+        /// mark dirty and tell the indexing space, call after every change of shape or position
+        void Moved();
     };
     typedef Geom* GeomPtr;
     // ߶
     class LineSegmentGeom : public Geom
     {
     public:
+        enum
+        {
+            StaticType = Geom::LineSeg,
+        };
         LineSegmentGeom()
         {
         }
@@ -119,26 +309,51 @@ namespace Phy2d
         {
             a = from;
             b = to;
+            ab = b - a;
+            float lenSq = dot_product(ab, ab);
+            invLenSq = lenSq > 0 ? 1.0f / lenSq : 0.0f;
+            dir = ab;
+            dir.norm();
+            normal.set(-dir.y, dir.x);
             boundingBox.begin_extend();
             boundingBox.extend(a);
             boundingBox.extend(b);
             boundingBox.end_extend();
-            dirty = true;
+            Moved();
         }
         virtual const vector2 &GetVector2(size_t index) const
         {
             return index == 0 ? a : b;
         }
+        virtual void Translate(const vector2 &offset)
+        {
+            a += offset;
+            b += offset;
+            Geom::Translate(offset);
+        }
 
         virtual float GetDistance(const vector2 &point, vector2 &shadow) const;
-        virtual bool CollisionRay(const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo);
-        virtual bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo);
+        virtual float GetDistanceSquared(const vector2 &point, vector2 &shadow) const;
+        using Geom::CollisionRay;
+        using Geom::CollisionCircle;
+        virtual bool CollisionRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo);
+        virtual bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo);
+        virtual bool SweepCircle(float radius, const vector2 &from, const vector2 &to, float &fraction, vector2 &normal);
         vector2 a, b;
+        // derived in SetLineSegment
+        vector2 ab;         // b - a
+        vector2 dir;        // unit vector from a to b
+        vector2 normal;     // dir turned left, flip it to face a point
+        float invLenSq;     // 1 / |b - a|^2, 0 for a point
     };
     // 
     class ArcGeom : public Geom
     {
     public:
+        enum
+        {
+            StaticType = Geom::Arc,
+        };
         virtual GeomType GetType() const
         {
             return Geom::Arc;
@@ -154,27 +369,39 @@ namespace Phy2d
             vector2 oa1(oa), oa2(oa);
             oa1.rotate(radian);
             oa2.rotate(-radian);
-            boundingBox.extend(center + oa1);
-            boundingBox.extend(center + oa2);
+            end1 = oa1 + center;
+            end2 = oa2 + center;
+            endRadius = oa1.len();
+            radiusSq = oa.x * oa.x + oa.y * oa.y;
+#ifdef PHY2D_DETERMINISTIC
+            cosRadian = det_cos(radian);
+#else
+            cosRadian = cos(radian);
+#endif
+            boundingBox.extend(end1);
+            boundingBox.extend(end2);
+            float r = oa.len();
             oa.norm();
-            if (acos(dot_product(vector2(0, 1), oa)) < radian)
+            axis = oa;
+            // the arc passes an axis direction e when acos(e dot axis) < radian
+            if (axis.y > cosRadian)
             {
-                boundingBox.extend(center + vector2(0, radian));
+                boundingBox.extend(center + vector2(0, r));
             }
-            if (acos(dot_product(vector2(0, -1), oa)) < radian)
+            if (-axis.y > cosRadian)
             {
-                boundingBox.extend(center + vector2(0, -radian));
+                boundingBox.extend(center + vector2(0, -r));
             }
-            if (acos(dot_product(vector2(1, 0), oa)) < radian)
+            if (axis.x > cosRadian)
             {
-                boundingBox.extend(center + vector2(radian, 0));
+                boundingBox.extend(center + vector2(r, 0));
             }
-            if (acos(dot_product(vector2(-1, 0), oa)) < radian)
+            if (-axis.x > cosRadian)
             {
-                boundingBox.extend(center + vector2(-radian, 0));
+                boundingBox.extend(center + vector2(-r, 0));
             }
             boundingBox.end_extend();
-            dirty = true;
+            Moved();
         }
         virtual const vector2 &GetVector2(size_t index) const
         {
@@ -184,12 +411,30 @@ namespace Phy2d
         {
             return radian;
         }
+        virtual void Translate(const vector2 &offset)
+        {
+            center += offset;
+            arc += offset;
+            end1 += offset;
+            end2 += offset;
+            Geom::Translate(offset);
+        }
         virtual float GetDistance(const vector2 &point, vector2 &shadow) const;
-        virtual bool CollisionRay(const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo);
-        virtual bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo);
+        virtual float GetDistanceSquared(const vector2 &point, vector2 &shadow) const;
+        using Geom::CollisionRay;
+        using Geom::CollisionCircle;
+        virtual bool CollisionRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo);
+        virtual bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo);
+        virtual bool SweepCircle(float radius, const vector2 &from, const vector2 &to, float &fraction, vector2 &normal);
         vector2 center;
         vector2 arc;
         float radian;
+        // derived in SetArc, keeps trig out of the queries
+        vector2 end1, end2; // both ends, arc rotated around center by +-radian
+        vector2 axis;       // unit vector from center to arc
+        float endRadius;    // |end1 - center|
+        float radiusSq;     // |arc - center|^2
+        float cosRadian;
         /*
         center at point 'o'
         arc at point 'a'
@@ -241,21 +486,479 @@ namespace Phy2d
            |
         */
     };
-    class RigidBody
+#endif
+    /// forwards the contacts to another sink and counts them
+    class CountingSink : public ContactSink
     {
     public:
-        vector<GeomPtr> geoms;
-        vector2 pos;
-        vector2 vel;
+        explicit CountingSink(ContactSink &next) : next(next), count(0)
+        {
+        }
+        virtual void AddContact(const CollisionInfo &ci)
+        {
+            count++;
+            next.AddContact(ci);
+        }
+        size_t GetCount() const
+        {
+            return count;
+        }
+    protected:
+        ContactSink &next;
+        size_t count;
+    private:
+        CountingSink &operator = (const CountingSink &);
+    };
+
+    /// counter policy of BasicQueryStats that counts
+    class StatCounter
+    {
+    public:
+        enum
+        {
+            Enabled = 1,
+        };
+        StatCounter() : value(0)
+        {
+        }
+        void Add(unsigned int n)
+        {
+            value += n;
+        }
+        void Max(unsigned int n)
+        {
+            if (n > value)
+                value = n;
+        }
+        unsigned int Get() const
+        {
+            return value;
+        }
+    protected:
+        unsigned int value;
+    };
+    /// counter policy of BasicQueryStats that drops everything, the counting compiles to nothing
+    class NullCounter
+    {
+    public:
+        enum
+        {
+            Enabled = 0,
+        };
+        void Add(unsigned int)
+        {
+        }
+        void Max(unsigned int)
+        {
+        }
+        unsigned int Get() const
+        {
+            return 0;
+        }
+    };
+
+    /*
+    What the queries of a space did: queries run, geom bounding boxes tested
+    and rejected, narrow phase tests and contacts by geom type, most contacts
+    of a single query. Many bbox rejects mean the broadphase hands over too
+    many geoms, many narrow tests per contact mean the boxes are too loose.
+
+    Every QueryContext carries its own, so each thread counts into the context
+    it queries with and nothing is shared; Add sums them up once the threads
+    are done. The non reentrant queries of a space count into Space::GetStats.
+    Reset them every frame for numbers per frame.
+
+    QueryStats counts with builds defining PHY2D_STATS, the default without
+    NDEBUG; otherwise it is BasicQueryStats<NullCounter> and the spaces pay
+    nothing for it.
+    */
+    template <class Counter>
+    class BasicQueryStats
+    {
+    public:
+        enum
+        {
+            NumGeomTypes = Geom::Space + 1,
+        };
+        /// counts one query of a space, from its construction to the end of the scope
+        class Scope
+        {
+        public:
+            explicit Scope(BasicQueryStats &stats) : stats(stats)
+            {
+                stats.BeginQuery();
+            }
+            ~Scope()
+            {
+                stats.EndQuery();
+            }
+        protected:
+            BasicQueryStats &stats;
+        private:
+            Scope &operator = (const Scope &);
+        };
+
+        static bool IsEnabled()
+        {
+            return Counter::Enabled != 0;
+        }
+        void Reset()
+        {
+            *this = BasicQueryStats();
+        }
+        /// sum of both, the counts of another thread or space
+        void Add(const BasicQueryStats &other)
+        {
+            queries.Add(other.queries.Get());
+            boxTests.Add(other.boxTests.Get());
+            boxRejects.Add(other.boxRejects.Get());
+            for (int i = 0; i < NumGeomTypes; i++)
+            {
+                narrowTests[i].Add(other.narrowTests[i].Get());
+                contacts[i].Add(other.contacts[i].Get());
+            }
+            maxContacts.Max(other.maxContacts.Get());
+        }
+
+        unsigned int GetQueries() const
+        {
+            return queries.Get();
+        }
+        unsigned int GetBoxTests() const
+        {
+            return boxTests.Get();
+        }
+        unsigned int GetBoxRejects() const
+        {
+            return boxRejects.Get();
+        }
+        unsigned int GetNarrowTests(Geom::GeomType type) const
+        {
+            return narrowTests[type].Get();
+        }
+        /// narrow phase tests of all geom types
+        unsigned int GetNarrowTests() const
+        {
+            unsigned int n = 0;
+            for (int i = 0; i < NumGeomTypes; i++)
+                n += narrowTests[i].Get();
+            return n;
+        }
+        unsigned int GetContacts(Geom::GeomType type) const
+        {
+            return contacts[type].Get();
+        }
+        unsigned int GetContacts() const
+        {
+            unsigned int n = 0;
+            for (int i = 0; i < NumGeomTypes; i++)
+                n += contacts[i].Get();
+            return n;
+        }
+        /// the most contacts one query reported
+        unsigned int GetMaxContacts() const
+        {
+            return maxContacts.Get();
+        }
+
+        // used by the spaces while running a query
+        void BeginQuery()
+        {
+            queryContacts = Counter();
+        }
+        void EndQuery()
+        {
+            AddQuery(queryContacts.Get());
+        }
+        /// a finished query of 'numContacts' contacts, for queries counted without Begin/EndQuery
+        void AddQuery(unsigned int numContacts)
+        {
+            queries.Add(1);
+            maxContacts.Max(numContacts);
+        }
+        /// one geom's bounding box tested, returns 'overlap'
+        bool CountBox(bool overlap)
+        {
+            boxTests.Add(1);
+            if (!overlap)
+                boxRejects.Add(1);
+            return overlap;
+        }
+        void CountBoxes(unsigned int tests, unsigned int overlaps)
+        {
+            boxTests.Add(tests);
+            boxRejects.Add(tests - overlaps);
+        }
+        void CountNarrow(Geom::GeomType type)
+        {
+            narrowTests[type].Add(1);
+        }
+        void CountNarrow(const Geom *geom)
+        {
+            // GetType is virtual, leave it out when nothing is counted
+            if (Counter::Enabled)
+                CountNarrow(geom->GetType());
+        }
+        void CountContacts(Geom::GeomType type, size_t n)
+        {
+            contacts[type].Add((unsigned int)n);
+            queryContacts.Add((unsigned int)n);
+        }
+        void CountContacts(const Geom *geom, size_t n)
+        {
+            if (Counter::Enabled)
+                CountContacts(geom->GetType(), n);
+        }
+        /// geom->CollisionRay, counted
+        bool CollisionRay(GeomPtr geom, const vector2 &from, const vector2 &to, ContactSink &collideinfo)
+        {
+            if (!Counter::Enabled)
+                return geom->CollisionRay(from, to, collideinfo);
+            CountNarrow(geom);
+            CountingSink sink(collideinfo);
+            bool found = geom->CollisionRay(from, to, sink);
+            CountContacts(geom, sink.GetCount());
+            return found;
+        }
+        /// geom->CollisionCircle, counted
+        bool CollisionCircle(GeomPtr geom, float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo)
+        {
+            if (!Counter::Enabled)
+                return geom->CollisionCircle(radius, from, to, collideinfo);
+            CountNarrow(geom);
+            CountingSink sink(collideinfo);
+            bool found = geom->CollisionCircle(radius, from, to, sink);
+            CountContacts(geom, sink.GetCount());
+            return found;
+        }
+    protected:
+        Counter queries;
+        Counter boxTests;
+        Counter boxRejects;
+        Counter narrowTests[NumGeomTypes];
+        Counter contacts[NumGeomTypes];
+        Counter maxContacts;
+        Counter queryContacts;  // of the running query
     };
+#ifdef PHY2D_STATS
+    typedef BasicQueryStats<StatCounter> QueryStats;
+#else
+    typedef BasicQueryStats<NullCounter> QueryStats;
 #endif
-    class Space;
-    typedef Space* SpacePtr;
+
+    /// result of a closest hit ray query
+    struct RayHit
+    {
+        RayHit() : fraction(1.0f), geom(0)
+        {
+        }
+        CollisionInfo info;
+        float fraction; // info.pos is about from + (to - from) * fraction
+        GeomPtr geom;
+    };
+    /*
+    Finds the contact of a ray closest to its start. Every geom is tested with
+    the ray cut off at the best hit so far, so geoms behind it fail the bounding
+    box test. On equal distance the geom tested first wins.
+    */
+    class ClosestRayHit : public ContactSink
+    {
+    public:
+        ClosestRayHit(const vector2 &from, const vector2 &to, QueryStats &stats);
+        /// run the clipped ray against 'geom', true if it gave a closer hit
+        bool Test(GeomPtr geom);
+        virtual void AddContact(const CollisionInfo &ci);
+
+        bool Found() const
+        {
+            return hit.geom != 0;
+        }
+        const RayHit &GetHit() const
+        {
+            return hit;
+        }
+        /// end of the ray clipped at the best hit so far, 'to' while nothing was hit
+        vector2 GetEnd() const
+        {
+            return Found() ? hit.info.pos : to;
+        }
+        /// bounding box of the clipped ray
+        bbox2 GetBound() const
+        {
+            return SweepBox(from, GetEnd(), 0);
+        }
+        const vector2 &GetFrom() const
+        {
+            return from;
+        }
+    protected:
+        vector2 from, to;
+        vector2 dir;
+        float invLenSq;
+        RayHit hit;
+        bool improved;      // set by AddContact during Test
+        size_t numContacts; // AddContact calls so far
+        QueryStats &stats;
+    private:
+        ClosestRayHit &operator = (const ClosestRayHit &);
+    };
+    /// earliest impact of a swept circle, culling like ClosestRayHit with the
+    /// swept box cut off at the best impact so far
+    class ClosestSweepHit
+    {
+    public:
+        ClosestSweepHit(float radius, const vector2 &from, const vector2 &to, QueryStats &stats);
+        /// sweep against 'geom', true if it is hit earlier
+        bool Test(GeomPtr geom);
+
+        bool Found() const
+        {
+            return hit.geom != 0;
+        }
+        /// info.pos is the circle's center at the impact
+        const RayHit &GetHit() const
+        {
+            return hit;
+        }
+        bbox2 GetBound() const
+        {
+            return SweepBox(from, Found() ? hit.info.pos : to, radius + CircleContactTolerance);
+        }
+    protected:
+        float radius;
+        vector2 from, to;
+        RayHit hit;
+        QueryStats &stats;
+    private:
+        ClosestSweepHit &operator = (const ClosestSweepHit &);
+    };
+    /// scratch memory of a running query. The const query functions of a space only
+    /// write to the context they are handed, so queries with a context each may run
+    /// on several threads at once
+    struct QueryContext
+    {
+        vector<size_t> candidates;
+        vector<CollisionInfo> contacts;
+        QueryStats stats;
+    };
+
+    /// a batch of ray queries in SoA form, query i goes from (fromX[i], fromY[i]) to (toX[i], toY[i])
+    struct RayQueryBatch
+    {
+        RayQueryBatch() : fromX(0), fromY(0), toX(0), toY(0), count(0)
+        {
+        }
+        vector2 GetFrom(size_t i) const
+        {
+            return vector2(fromX[i], fromY[i]);
+        }
+        vector2 GetTo(size_t i) const
+        {
+            return vector2(toX[i], toY[i]);
+        }
+        /// the queries [begin, end) of this batch
+        RayQueryBatch Slice(size_t begin, size_t end) const
+        {
+            assert(begin <= end && end <= count);
+            RayQueryBatch b;
+            b.fromX = fromX + begin;
+            b.fromY = fromY + begin;
+            b.toX = toX + begin;
+            b.toY = toY + begin;
+            b.count = end - begin;
+            return b;
+        }
+        const float *fromX, *fromY;
+        const float *toX, *toY;
+        size_t count;
+    };
+    /// a batch of circle queries, query i moves a circle of radius[i] along ray i
+    struct CircleQueryBatch : public RayQueryBatch
+    {
+        CircleQueryBatch() : radius(0)
+        {
+        }
+        CircleQueryBatch Slice(size_t begin, size_t end) const
+        {
+            CircleQueryBatch b;
+            static_cast<RayQueryBatch &>(b) = RayQueryBatch::Slice(begin, end);
+            b.radius = radius + begin;
+            return b;
+        }
+        const float *radius;
+    };
+    /*
+    Result of a batched query: one flat contact array, the contacts of query i
+    are contacts[offsets[i]] .. contacts[offsets[i + 1] - 1], in the order a
+    single CollisionCircle/CollisionRay call would report them.
+    Keep the buffer around between frames, it reuses its memory.
+    */
+    class ContactBuffer
+    {
+    public:
+        size_t GetNumQueries() const
+        {
+            return lastCollision.size();
+        }
+        size_t GetCount(size_t query) const
+        {
+            return offsets[query + 1] - offsets[query];
+        }
+        const CollisionInfo *GetContacts(size_t query) const
+        {
+            return GetCount(query) ? &contacts[offsets[query]] : 0;
+        }
+        /// the geom that reported the last contact of 'query', 0 if none
+        GeomPtr GetLastCollision(size_t query) const
+        {
+            return lastCollision[query];
+        }
+
+        // used by the spaces while running a batch
+        void Begin(const CircleQueryBatch &batch);
+        void Begin(const RayQueryBatch &batch);
+        /// narrow phase of one geom against circle query 'query' of the running batch
+        void AddCircle(GeomPtr geom, size_t query);
+        /// run circle query 'query' through space->QueryCircle and keep the result
+        void AddCircleQuery(const Space &space, size_t query);
+        /// run ray query 'query' through space->QueryRay and keep the result
+        void AddRayQuery(const Space &space, size_t query);
+        /// sort the contacts by query, keeping the order they were found in
+        void End();
+        /// count the queries of the batch in context.stats, after End, for batches not run through QueryCircle
+        void CountQueries();
+        /// the results of 'numParts' buffers one after the other, parts[i] ran the queries following parts[i - 1]
+        void Assign(const ContactBuffer *parts, size_t numParts);
+        /// the swept box of 'query' grown by the contact tolerance overlaps 'box'
+        bool Overlap(size_t query, const bbox2 &box) const
+        {
+            return !(box.vmax.x < minX[query] || box.vmin.x > maxX[query] ||
+                     box.vmax.y < minY[query] || box.vmin.y > maxY[query]);
+        }
+
+        // swept boxes of the running batch, SoA like the batch itself
+        vector<float> minX, minY, maxX, maxY;
+        // scratch owned by the spaces
+        vector<unsigned char> hitMask;
+        vector<size_t> active;
+        QueryContext context;
+    protected:
+        void SetBounds(size_t count, float margin);
+
+        CircleQueryBatch batch;         // radius is 0 for ray batches
+        vector<CollisionInfo> contacts;
+        vector<size_t> offsets;
+        vector<GeomPtr> lastCollision;
+
+        vector<CollisionInfo> pending;  // contacts in the order the geoms were visited
+        vector<size_t> pendingQuery;    // query of each pending contact
+        vector<size_t> cursor;
+    };
 
     class Space : public Geom
     {
     public:
-        Space() : topSpace(this)
+        Space() : lastCollision(0), topSpace(this)
         {
         }
         virtual GeomType GetType() const
@@ -267,38 +970,95 @@ namespace Phy2d
         {
             newgeoms.push_back(geom);
         }
+        /// called by a geom registered with SetSpace whenever it moves
+        virtual void OnGeomMoved(GeomPtr /*geom*/)
+        {
+        }
+        using Geom::CollisionRay;
+        using Geom::CollisionCircle;
         /// move from 'from' to 'to', but may collide at the collide position
-        virtual bool CollisionRay(const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+        virtual bool CollisionRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo)
+        {
+            lastCollision = 0;
+            return QueryRay(from, to, collideinfo, lastCollision, context);
+        }
+        /// the hit closest to 'from' only, GetLastCollision returns its geom
+        bool CollisionRayClosest(const vector2 &from, const vector2 &to, RayHit &hit)
+        {
+            bool found = QueryRayClosest(from, to, hit, context);
+            lastCollision = hit.geom;
+            return found;
+        }
+        virtual bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo)
+        {
+            lastCollision = 0;
+            return QueryCircle(radius, from, to, collideinfo, lastCollision, context);
+        }
+        /// reentrant CollisionRay: the space is not touched, 'hit' receives the geom of the last contact.
+        /// The contacts go straight to 'collideinfo', with a ContactArray a query allocates nothing
+        virtual bool QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
         {
+            QueryStats::Scope count(context.stats);
+            bool found = false;
             for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
             {
-                vector<CollisionInfo> ci;
-                if ((*g)->CollisionRay(from, to, ci))
+                if (context.stats.CollisionRay(*g, from, to, collideinfo))
                 {
-                    collideinfo.insert(collideinfo.end(), ci.begin(), ci.end());
-                    lastCollision = *g;
+                    hit = *g;
+                    found = true;
                 }
             }
-            return lastCollision != 0;
+            return found;
         }
-        virtual bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+        /// reentrant CollisionRayClosest, 'hit' is left alone when nothing is hit
+        virtual bool QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        /// earliest impact over all geoms, GetLastCollision returns the geom hit
+        virtual bool SweepCircle(float radius, const vector2 &from, const vector2 &to, float &fraction, vector2 &normal)
         {
+            RayHit hit;
             lastCollision = 0;
+            if (!QuerySweepCircle(radius, from, to, hit, context))
+                return false;
+            lastCollision = hit.geom;
+            fraction = hit.fraction;
+            normal = hit.info.normal;
+            return true;
+        }
+        /// reentrant SweepCircle, hit.info.pos is the circle's center at the impact
+        virtual bool QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        /// reentrant CollisionCircle: the space is not touched, 'hit' receives the geom of the last contact
+        virtual bool QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+        {
+            QueryStats::Scope count(context.stats);
+            bool found = false;
             for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
             {
-                vector<CollisionInfo> ci;
-                if ((*g)->CollisionCircle(radius, from, to, ci))
+                if (context.stats.CollisionCircle(*g, radius, from, to, collideinfo))
                 {
-                    collideinfo.insert(collideinfo.end(), ci.begin(), ci.end());
-                    lastCollision = *g;
+                    hit = *g;
+                    found = true;
                 }
             }
-            return lastCollision != 0;
+            return found;
         }
         virtual GeomPtr GetLastCollision() const 
         {
             return this->lastCollision;
         }
+        /// what the non reentrant queries (CollisionRay, CollisionCircle, SweepCircle...) did since ResetStats
+        const QueryStats &GetStats() const
+        {
+            return context.stats;
+        }
+        void ResetStats()
+        {
+            context.stats.Reset();
+        }
+        /// run every circle query of 'batch' in one pass over the geoms, results go to 'out'.
+        /// Same contacts as one CollisionCircle per query; reentrant like QueryCircle
+        virtual void CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const;
+        /// run every ray query of 'batch', reentrant like QueryRay
+        virtual void CollisionRayBatch(const RayQueryBatch &batch, ContactBuffer &out) const;
         // geomλãתƣtrue򷵻false
         virtual bool Update()
         {
@@ -323,222 +1083,38 @@ namespace Phy2d
         {
             return geoms;
         }
+        /// append every geom held by this space, including those kept by sub spaces
+        virtual void CollectGeoms(vector<GeomPtr> &out) const
+        {
+            out.insert(out.end(), geoms.begin(), geoms.end());
+            out.insert(out.end(), newgeoms.begin(), newgeoms.end());
+        }
 
-        void Clear()
+        virtual void Clear()
         {
             newgeoms.clear();
             geoms.clear();
             lastCollision = 0;
         }
     protected:
+        /// batch fallback for spaces without a shared traversal, one QueryCircle per query
+        void CollisionCircleBatchPerQuery(const CircleQueryBatch &batch, ContactBuffer &out) const;
+
         vector<GeomPtr> newgeoms;
         vector<GeomPtr> geoms;
 
         GeomPtr lastCollision;
+        QueryContext context;   // scratch of the non reentrant CollisionRay/CollisionCircle
 
         SpacePtr topSpace; // dirtyʱת͵spaceȥ
     };
-#if 0
-    class QuadSplitSpace : public Space
-    {
-    public:
-        QuadSplitSpace()
-        {
-
-        }
-        /*
-             ^ y
-         LT  |  RT
-        -----+------> x
-         LB  |  RB
-        */
-        enum SubSpaceIndex
-        {
-            LeftTop,
-            RightTop,
-            LeftBottom,
-            RightBottom,
-
-            NumSubSpaces,
-        };
-
-        /// move from 'from' to 'to', but may collide at the collide position
-        virtual bool CollisionRay(const vector2 &from, const vector2 &to, vector2 &collide, vector2 &normal)
-        {
-            bool flag = false;
-            vector2 newCollidePosition;
-            vector2 newNormal;
-            collide = to;
-            for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
-            {
-                if ((*g)->CollisionRay(from, collide, newCollidePosition, newNormal))
-                {
-                    collide = newCollidePosition;
-                    normal = newNormal;
-                    flag = true;
-                }
-            }
-
-            // check childs
-            for (SubSpaceIndex subSpaceIndex = SubSpaceIndex(0); subSpaceIndex < NumSubSpaces; subSpaceIndex = SubSpaceIndex(subSpaceIndex + 1))
-            {
-                if (PointInSubSpace(from, subSpaceIndex) || PointInSubSpace(collide, subSpaceIndex) ||
-                    LineCrossSubSpace(from, collide, subSpaceIndex))
-                {
-                    if (child[subSpaceIndex]->CollisionRay(from, collide, newCollidePosition, newNormal))
-                    {
-                        collide = newCollidePosition;
-                        normal = newNormal;
-                        flag = true;
-                    }
-                }
-            }
-
-            return flag;
-        }
 
-        /// move from 'from' to 'to', but may collide at the collide position
-        virtual bool CollisionCircle(float radius, const vector2 &from, const vector2 &to, vector2 &collide, vector2 &normal, float &collisionDepth)
-        {
-            bool flag = false;
-            vector2 newCollidePosition;
-            vector2 newNormal;
-            float newCollisionDepth;
-            collide = to;
-            for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
-            {
-                if ((*g)->CollisionCircle(radius, from, collide, newCollidePosition, newNormal, newCollisionDepth))
-                {
-                    collide = newCollidePosition;
-                    normal = newNormal;
-                    collisionDepth = newCollisionDepth;
-                    flag = true;
-                }
-            }
-
-            // check childs
-            for (SubSpaceIndex subSpaceIndex = SubSpaceIndex(0); subSpaceIndex < NumSubSpaces; subSpaceIndex = SubSpaceIndex(subSpaceIndex + 1))
-            {
-                if (PointInSubSpace(from, subSpaceIndex) || PointInSubSpace(collide, subSpaceIndex) ||
-                    LineCrossSubSpace(from, collide, subSpaceIndex))
-                {
-                    if (child[subSpaceIndex]->CollisionCircle(radius, from, collide, newCollidePosition, newNormal, newCollisionDepth))
-                    {
-                        collide = newCollidePosition;
-                        normal = newNormal;
-                        collisionDepth = newCollisionDepth;
-                        flag = true;
-                    }
-                }
-            }
-
-            return flag;
-        }
-        bool PointInSubSpace(const vector2 &p, SubSpaceIndex index) const
-        {
-            switch(index)
-            {
-            case LeftTop:
-                return p.x < splitCenter.x && p.y > splitCenter.y;
-            case RightTop:
-                return p.x > splitCenter.x && p.y > splitCenter.y;
-            case LeftBottom:
-                return p.x < splitCenter.x && p.y < splitCenter.y;
-            case RightBottom:
-                return p.x > splitCenter.x && p.y < splitCenter.y;
-            }
-            assert(0);
-            return false;
-        }
-        bool LineCrossSubSpace(const vector2 &from, const vector2 &to, SubSpaceIndex index) const
-        {
-            vector2 axis_pos; // all zeros
-            vector2 off(to - from);
-            if (abs(off.x) < TINY)
-            {
-                if (from.y > 0 && to.y < 0 || from.y < 0 && to.y > 0)
-                    axis_pos.x = off.x;
-            }
-            else if (abs(off.y) < TINY)
-            {
-                if (from.x > 0 && to.x < 0 || from.x < 0 && to.x > 0)
-                    axis_pos.y = off.y;
-            }
-            else
-            {
-                if (from.y > 0 && to.y < 0 || from.y < 0 && to.y > 0)
-                    axis_pos.x = from.x + off.x * from.y / off.y;
-
-                if (from.x > 0 && to.x < 0 || from.x < 0 && to.x > 0)
-                    axis_pos.y = from.y + off.y * from.x / off.x;
-            }
-            switch(index)
-            {
-            case LeftTop:
-                return axis_pos.x < -TINY || axis_pos.y > TINY;
-            case RightTop:
-                return axis_pos.x > TINY || axis_pos.y > TINY;
-            case LeftBottom:
-                return axis_pos.x < -TINY || axis_pos.y < -TINY;
-            case RightBottom:
-                return axis_pos.x > TINY || axis_pos.y < -TINY;
-            }
-            assert(0);
-            return false;
-        }
-    
-        virtual bool Update()
-        {
-            bool flag = false;
-            for (vector<GeomPtr>::iterator g = newgeoms.begin(); g != newgeoms.end();)
-            {
-                if ((*g)->GetDirty()) // ƶ
-                {
-                    topSpace->AddGeom(*g); // Ҫ·λ
-                    *g = newgeoms.back();
-                    newgeoms.pop_back();
-                    flag = true;
-                }
-                else
-                    ++g;
-            }
-            if (!newgeoms.empty())
-            {
-                for (vector<GeomPtr>::const_iterator g = newgeoms.begin(); g != newgeoms.end(); ++g)
-                {
-                    const bbox2 &box= (*g)->GetBBox();
-                    if (box.vmin.x > splitCenter.x)
-                    {
-                        if (box.vmin.y > splitCenter.y)
-                            child[RightTop]->AddGeom(*g);
-                        else if (box.vmax.y < splitCenter.y)
-                            child[RightBottom]->AddGeom(*g);
-                        else
-                            geoms.push_back(*g);
-                    }
-                    else if (box.vmax.x < splitCenter.x)
-                    {
-                        if (box.vmin.y > splitCenter.y)
-                            child[LeftTop]->AddGeom(*g);
-                        else if (box.vmax.y < splitCenter.y)
-                            child[LeftBottom]->AddGeom(*g);
-                        else
-                            geoms.push_back(*g);
-                    }
-                    else
-                        geoms.push_back(*g);
-                }
-                newgeoms.clear();
-            }
-            return flag;
-        }
-
-        vector2 splitCenter;
-
-        // all geoms in child must stay in its sub-area and not cross splitCenter-defined cross lines
-        SpacePtr child[NumSubSpaces];
-    };
-#endif
+    inline void Geom::Moved()
+    {
+        dirty = true;
+        if (space)
+            space->OnGeomMoved(this);
+    }
 }
 
 #endif
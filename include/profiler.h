@@ -0,0 +1,103 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+
+using namespace std;
+
+/*
+Frame profiler of nested, named zones.
+
+    void Foo()
+    {
+        PROFILE_ZONE("Foo");
+        ...
+    }
+
+records when Foo starts and ends, as a child of the zone around the call.
+PROFILE_NEXT_FRAME() ends a frame and starts the next; the zones of the last
+MaxFrames frames are kept for the on-screen overlay and for a Chrome
+trace-event dump (chrome://tracing or ui.perfetto.dev).
+
+The macros are empty unless PROFILER_ENABLED is defined, which profiler.h
+does for builds without NDEBUG; premake --profile turns it on for release
+builds as well. Zones are recorded on the main thread only, the names must
+be string literals.
+*/
+#if !defined(PROFILER_ENABLED) && !defined(NDEBUG)
+#define PROFILER_ENABLED
+#endif
+
+class Profiler
+{
+public:
+    enum
+    {
+        MaxFrames = 120,            // frames kept
+        MaxZonesPerFrame = 16384,   // later zones of a frame are not recorded
+    };
+    struct Zone
+    {
+        const char *name;
+        int depth;      // 0 for the outermost zones
+        double begin;   // microseconds since the profiler started
+        double end;
+    };
+
+    static Profiler &Instance();
+
+    /// start recording zone 'name', returns what Leave needs
+    int Enter(const char *name);
+    void Leave(int zone);
+    /// close the current frame and start a new one, outside of all zones
+    void NextFrame();
+
+    /// number of finished frames kept, at most MaxFrames
+    int GetFrameCount() const;
+    /// the zones of a finished frame, 0 is the last one, in the order they were entered
+    const vector<Zone> &GetFrame(int age) const;
+    /// write the finished frames kept, oldest first, as Chrome trace-event JSON
+    bool WriteChromeTrace(const char *path) const;
+
+    /// microseconds since the profiler started
+    double GetTime() const;
+protected:
+    Profiler();
+
+    double start;           // in seconds of the system clock
+    vector<vector<Zone> > frames;   // ring of MaxFrames + 1, 'current' is being recorded
+    int current;
+    int finished;           // frames finished so far, up to MaxFrames
+    int depth;              // zones entered and not left yet
+private:
+    Profiler(const Profiler &);
+    Profiler &operator = (const Profiler &);
+};
+
+/// records the zone from its construction to the end of the scope
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char *name) : zone(Profiler::Instance().Enter(name))
+    {
+    }
+    ~ProfileZone()
+    {
+        Profiler::Instance().Leave(zone);
+    }
+protected:
+    int zone;
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+
+#ifdef PROFILER_ENABLED
+#define PROFILE_ZONE(name) ProfileZone PROFILE_JOIN(profileZone, __LINE__)(name)
+#define PROFILE_NEXT_FRAME() Profiler::Instance().NextFrame()
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_NEXT_FRAME() ((void)0)
+#endif
+
+#endif//PROFILER_H
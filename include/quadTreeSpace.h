@@ -0,0 +1,101 @@
+#ifndef QUAD_TREE_SPACE_H
+#define QUAD_TREE_SPACE_H
+
+#include "phy2d.h"
+
+namespace Phy2d
+{
+    /*
+    Loose quad tree.
+
+    Every node covers a quarter of its parent's area, but accepts geoms whose
+    bounding box fits into the area grown by 'looseness' around the node's
+    center, so a geom never has to be split and always lives in exactly one
+    node. Geoms that do not fit anywhere (too big, or outside the root area)
+    stay in the root.
+
+    Every geom is registered with the node holding it (Geom::SetSpace, the
+    proxy is its index there), so a moved geom tells its node, which lists it
+    in the root. Update looks at the listed geoms only: one still fitting the
+    loose area of its node stays there, only one that left it is removed and
+    inserted again from the root. Geoms that do not move cost nothing per
+    frame, and one call of Update brings the tree up to date.
+         ^ y
+     LT  |  RT
+    -----+------> x
+     LB  |  RB
+    */
+    class QuadTreeSpace : public Space
+    {
+    public:
+        enum SubSpaceIndex
+        {
+            LeftTop,
+            RightTop,
+            LeftBottom,
+            RightBottom,
+
+            NumSubSpaces,
+        };
+
+        /// @param area     region covered by the tree, geoms outside are kept in the root
+        /// @param maxDepth number of levels below the root
+        /// @param looseness how far a node accepts geoms outside its area, 1 is a plain quad tree
+        QuadTreeSpace(const bbox2 &area, int maxDepth = 6, float looseness = 2.0f);
+        virtual ~QuadTreeSpace();
+
+        virtual bool QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const;
+        virtual bool QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        virtual bool QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const;
+        virtual bool QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const;
+        virtual void CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const;
+        virtual void OnGeomMoved(GeomPtr geom);
+        virtual bool Update();
+        virtual void CollectGeoms(vector<GeomPtr> &out) const;
+        virtual void Clear();
+
+        const bbox2 &GetArea() const
+        {
+            return area;
+        }
+        /// remove all geoms and cover 'area' from now on
+        void Reset(const bbox2 &area, int maxDepth);
+        /// moved geoms that the last Update had to put into another node
+        size_t GetReinsertedCount() const
+        {
+            return numReinserted;
+        }
+    protected:
+        QuadTreeSpace(QuadTreeSpace *parent, SubSpaceIndex index);
+
+        void Insert(GeomPtr geom);
+        void Remove(size_t index);
+        bool QueryRayNode(const bbox2 &bound, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryStats &stats) const;
+        void QueryRayClosestNode(ClosestRayHit &closest) const;
+        void QuerySweepCircleNode(ClosestSweepHit &closest) const;
+        bool QueryCircleNode(const bbox2 &bound, float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryStats &stats) const;
+        /// the queries out.active[begin, end) reached this node
+        void QueryCircleBatchNode(size_t begin, size_t end, ContactBuffer &out) const;
+        SubSpaceIndex GetSubSpaceIndex(const vector2 &p) const;
+        void SetArea(const bbox2 &area);
+
+        bbox2 area;         // the quarter this node is responsible for
+        bbox2 looseArea;    // area grown by looseness, every geom in this node fits in here
+        float looseness;
+        int depth;
+        int maxDepth;
+        size_t count;       // geoms in this node and all its children
+
+        QuadTreeSpace *parent;
+        QuadTreeSpace *child[NumSubSpaces];
+
+        // root only
+        vector<GeomPtr> moved;  // told by OnGeomMoved since the last Update, may hold a geom twice
+        size_t numReinserted;
+    private:
+        QuadTreeSpace(const QuadTreeSpace &);
+        QuadTreeSpace &operator = (const QuadTreeSpace &);
+    };
+}
+
+#endif//QUAD_TREE_SPACE_H
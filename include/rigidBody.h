@@ -0,0 +1,85 @@
+#ifndef RIGID_BODY_H
+#define RIGID_BODY_H
+
+#include <vector>
+#include "phy2d.h"
+#include "stateHash.h"
+
+using namespace std;
+
+namespace Phy2d
+{
+    /*
+    Kinematic body: it moves where it is told and nothing pushes it back,
+    carrying the geoms it owns along, like a moving platform.
+
+    Geoms support translation, not rotation, so the transform is a position.
+    A geom keeps the shape it has when AddGeom is called as its shape at the
+    body's position of that moment (Geom::toParent); every move of the body
+    translates it by the same amount (Geom::toWorld). Each translated geom
+    tells its space through Geom::Moved, so a space that keeps track of
+    moved geoms, like QuadTreeSpace, only looks at the geoms of bodies that
+    moved.
+
+    The body does not own the geoms' memory, the caller deletes them.
+    */
+    class RigidBody
+    {
+    public:
+        RigidBody();
+        ~RigidBody();
+
+        /// 'geom' moves with the body from now on, it may belong to one body only
+        void AddGeom(GeomPtr geom);
+        const vector<GeomPtr> &GetGeoms() const
+        {
+            return geoms;
+        }
+        /// put the body at 'pos' at once, the velocity is left alone
+        void SetPosition(const vector2 &pos);
+        const vector2 &GetPosition() const
+        {
+            return pos;
+        }
+        void SetVelocity(const vector2 &vel)
+        {
+            this->vel = vel;
+        }
+        const vector2 &GetVelocity() const
+        {
+            return vel;
+        }
+        /// move by the velocity for 'delta' seconds. Returns whether the body moved
+        bool Step(float delta);
+        /// get to 'pos' in 'delta' seconds: the velocity is set to what gets it there. Returns whether the body moved
+        bool MoveTo(const vector2 &pos, float delta);
+        /// box around all the geoms
+        const bbox2 &GetBBox() const
+        {
+            return bounds;
+        }
+        void HashState(StateHash &hash) const
+        {
+            hash.Add(pos);
+            hash.Add(vel);
+        }
+    protected:
+        /// translate the geoms to the body's position
+        void Place();
+
+        vector<GeomPtr> geoms;
+        vector2 pos;
+        vector2 vel;
+        bbox2 bounds;
+    private:
+        RigidBody(const RigidBody &);
+        RigidBody &operator = (const RigidBody &);
+    };
+
+    /// how the ground under a circle moves: the velocity of the body of the contact
+    /// pushing hardest, 0 when that is a static geom. Moving the circle along before
+    /// its next contact query keeps it on a platform that moves away from it
+    vector2 SupportVelocity(const CollisionInfo *contacts, size_t count);
+}
+
+#endif//RIGID_BODY_H
@@ -0,0 +1,124 @@
+#ifndef SEGMENT_SPACE_H
+#define SEGMENT_SPACE_H
+
+#include "phy2d.h"
+
+namespace Phy2d
+{
+    /*
+    Line segments kept as plain float arrays (structure of arrays), so the
+    distance from a point to many segments can be computed 4 (SSE) or 8 (AVX)
+    at a time. Build with PHY2D_NO_SIMD to force the scalar loop.
+    The arrays are padded with segments far away, which never pass a test.
+    */
+    class SegmentStore
+    {
+    public:
+        enum
+        {
+            Width = 8,  // arrays are padded to a multiple of this
+        };
+        SegmentStore() : count(0)
+        {
+        }
+        /// append a slot, return its index
+        size_t Add();
+        void SetSegment(size_t slot, const vector2 &a, const vector2 &b);
+        void Clear();
+        size_t GetCount() const
+        {
+            return count;
+        }
+
+        /// append the slots whose squared distance to 'point' may be at most maxDistance^2,
+        /// in slot order. The test errs on the near side, callers run the exact test after
+        void GatherNear(const vector2 &point, float maxDistance, vector<size_t> &out) const;
+        /// squared distance from 'point' to the segment in 'slot', computed like the batch kernel
+        float GetDistanceSquared(size_t slot, const vector2 &point) const;
+    protected:
+        void Reserve(size_t n);
+
+        size_t count;
+        vector<float> ax, ay;       // first end point
+        vector<float> abx, aby;     // b - a
+        vector<float> invLenSq;     // 1 / |b - a|^2, 0 for a point
+    };
+
+    /*
+    Arcs in the same layout, with everything ArcGeom::GetDistance needs
+    worked out beforehand: both end points, the center, the radius, the
+    direction to the middle of the arc and the cosine of the half angle.
+    The kernel needs one square root per arc and no trig.
+    */
+    class ArcStore
+    {
+    public:
+        enum
+        {
+            Width = 8,
+        };
+        ArcStore() : count(0)
+        {
+        }
+        size_t Add();
+        void SetArc(size_t slot, const ArcGeom &arc);
+        void Clear();
+        size_t GetCount() const
+        {
+            return count;
+        }
+
+        /// same contract as SegmentStore::GatherNear
+        void GatherNear(const vector2 &point, float maxDistance, vector<size_t> &out) const;
+        float GetDistanceSquared(size_t slot, const vector2 &point) const;
+    protected:
+        void Reserve(size_t n);
+
+        size_t count;
+        vector<float> cx, cy;       // center
+        vector<float> radius;
+        vector<float> axisX, axisY; // unit vector to the middle of the arc
+        vector<float> cosLimit;     // cosine of the half angle, a little lower to err on the near side
+        vector<float> e1x, e1y;     // end points
+        vector<float> e2x, e2y;
+    };
+
+    /*
+    Space for static level geometry made of line segments and arcs.
+
+    Segments and arcs get a slot in a SegmentStore or an ArcStore. A circle
+    query first runs the vectorized distance filters and only calls
+    CollisionCircle on the geoms that passed, in the order they were added,
+    so the contacts are exactly those of Space's linear scan. Geoms of other
+    types are always tested. Moved geoms are re-read by Update.
+    */
+    class SegmentSpace : public Space
+    {
+    public:
+        virtual bool QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const;
+        virtual void CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const;
+        virtual bool Update();
+        virtual void Clear();
+
+        const SegmentStore &GetSegments() const
+        {
+            return segments;
+        }
+        const ArcStore &GetArcs() const
+        {
+            return arcs;
+        }
+    protected:
+        void Insert(size_t index);
+        void Refresh(size_t index);
+
+        SegmentStore segments;
+        ArcStore arcs;
+        vector<size_t> segmentGeoms;    // geom index of every segment slot
+        vector<size_t> arcGeoms;        // geom index of every arc slot
+        vector<size_t> otherGeoms;      // geoms tested by every query
+        vector<size_t> slots;           // slot of geoms[i] in its store
+    };
+}
+
+#endif//SEGMENT_SPACE_H
@@ -0,0 +1,133 @@
+#ifndef SIM_WORLD_H
+#define SIM_WORLD_H
+
+#include "phy2d.h"
+#include "quadTreeSpace.h"
+#include "spaceMap.h"
+#include "sweepAndPrune.h"
+#include "stateHash.h"
+#include "levelGenerator.h"
+#include "moverStore.h"
+#include "parallelQuery.h"
+#include "rigidBody.h"
+
+/**
+Everything that is simulated, without rendering or the engine: the level's
+geoms, the space holding them, the moving platforms, the movers and the map
+they move through, and a crowd of AI matchmen kept in a MoverStore.
+MainGameState draws it, the headless runner drives it from scripts.
+
+A step is MoveBodies, UpdateSpace, SavePositions, RunMovers, UpdateMovers and
+StepCrowd, in that order; Step runs them all. A platform is a segment on a
+kinematic RigidBody going back and forth along a straight path; the ones
+that moved are listed, and UpdateSpace wakes the sleeping movers and crowd
+members near them, both where they were and where they are now. The space
+re-indexes the moved geoms by itself, see QuadTreeSpace. Geoms moved
+without a body wake nobody.
+*/
+class SimWorld
+{
+public:
+    SimWorld();
+    ~SimWorld();
+
+    /// the level of the game: the frame, the pillars and a few geoms generated from 'seed'
+    void BuildLevel(unsigned int seed);
+    /// a generated level, the space is set up to cover it
+    void BuildLevel(const LevelParams &params);
+    /// add 'count' moving platforms in the level area, placed from 'seed'
+    void AddPlatforms(size_t count, unsigned int seed);
+    /// remove the movers and delete the geoms, needed before building another level
+    void Clear();
+    /// the object moves through this world's map from now on
+    void AddMover(MoveObject *object);
+    /// add 'count' AI matchmen to the crowd, in rows from the top of the level area on the spots
+    /// clear of geoms; when there are more than spots they are stacked. Their AI starts from 'seed'
+    void AddCrowd(size_t count, unsigned int seed);
+    /// threads running the crowd's queries, the caller included. 0 uses one per core
+    void SetNumThreads(int numThreads);
+    /// let idle movers and crowd members sleep, on by default
+    void SetCanSleep(bool canSleep);
+
+    /// one fixed step of 'delta' seconds
+    void Step(float delta);
+    /// move the platforms along their paths
+    void MoveBodies(float delta);
+    /// bring the space up to date with moved geoms, waking what the moved platforms touch
+    void UpdateSpace();
+    /// remember every mover's position, see MoveObject::GetRenderPosition
+    void SavePositions();
+    /// OnFrame of every mover
+    void RunMovers(float delta);
+    /// update the broadphase and push apart movers whose circles overlap
+    void UpdateMovers();
+    /// move the crowd
+    void StepCrowd(float delta);
+    /// hash of the geoms and the movers, runs that went the same way so far have the same one
+    unsigned int HashWorld() const;
+
+    Phy2d::QuadTreeSpace &GetSpace()
+    {
+        return world;
+    }
+    const vector<Phy2d::GeomPtr> &GetGeoms() const
+    {
+        return geoms;
+    }
+    size_t GetPlatformCount() const
+    {
+        return platforms.size();
+    }
+    const SweepAndPrune &GetMovers() const
+    {
+        return movers;
+    }
+    const MoverStore &GetCrowd() const
+    {
+        return crowd;
+    }
+    /// inside of the level, where the crowd is put
+    const bbox2 &GetLevelArea() const
+    {
+        return levelArea;
+    }
+protected:
+    /// a body going back and forth between 'from' and from + dir * length
+    struct Platform
+    {
+        Phy2d::RigidBody *body;
+        vector2 from;
+        vector2 dir;        // unit vector
+        float length;
+        float travelled;    // from 'from' to the body
+        float speed;        // negative on the way back
+        bbox2 lastBox;      // body's box at the last UpdateSpace
+        bool listed;        // in movedPlatforms
+    };
+
+    Phy2d::LineSegmentGeom *CreateLineSegment(const vector2 &a, const vector2 &b);
+    /// generate the geoms of 'params' and add them
+    void AddGenerated(const LevelParams &params);
+    void ResolvePushes();
+    /// no geom within 'radius' of 'pos'
+    bool IsClear(const vector2 &pos, float radius) const;
+    /// wake the sleepers touching any of 'areas'
+    void Wake(const vector<bbox2> &areas);
+
+    Phy2d::QuadTreeSpace world;
+    SpaceMap map;
+    vector<Phy2d::GeomPtr> geoms;
+    vector<Platform> platforms;
+    vector<size_t> movedPlatforms;  // moved since the last UpdateSpace
+    vector<bbox2> wakeAreas;        // scratch of UpdateSpace
+    SweepAndPrune movers;
+    MoverStore crowd;
+    Phy2d::ParallelQuery *parallel; // 0 while the crowd is run on the calling thread only
+    bbox2 levelArea;
+    bool canSleep;
+private:
+    SimWorld(const SimWorld &);
+    SimWorld &operator = (const SimWorld &);
+};
+
+#endif//SIM_WORLD_H
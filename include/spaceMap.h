@@ -0,0 +1,67 @@
+#ifndef SPACE_MAP_H
+#define SPACE_MAP_H
+
+#include "mapQuery.h"
+#include "moveObject.h"
+#include "phy2d.h"
+#include "profiler.h"
+
+/// MapQuery answered by the geoms of a Phy2d::Space
+class SpaceMap : public MapQuery
+{
+public:
+    enum
+    {
+        MaxSlides = 4,  // impacts handled by one SweepMove, the rest of the move is dropped
+    };
+    SpaceMap(Phy2d::Space *_world) : world(_world)
+    {
+    }
+    virtual CollisionType QueryMove(MoveObject *object, const vector2 &from, const vector2 &to, vector2 & /*suggest*/)
+    {
+        vector<Phy2d::CollisionInfo> &ci = object->GetCollisionInfo();
+        ci.clear();
+        PROFILE_ZONE("Space::CollisionCircle");
+        if (world->CollisionCircle(object->GetRadius(), from, to, ci))
+        {
+            Phy2d::GeomPtr g = world->GetLastCollision();
+            if (g)
+            {
+                g->GetData();
+            }
+            return MapQuery::CT_Ground;
+        }
+        return MapQuery::CT_None;
+    }
+    virtual CollisionType SweepMove(MoveObject *object, const vector2 &from, const vector2 &to, vector2 &suggest,
+        vector2 *velocity = 0)
+    {
+        PROFILE_ZONE("Space::SweepCircle");
+        CollisionType type = MapQuery::CT_None;
+        vector2 pos = from;
+        vector2 rest = to - from;
+        for (int i = 0; i < MaxSlides; i++)
+        {
+            float fraction;
+            vector2 normal;
+            if (!world->SweepCircle(object->GetRadius(), pos, pos + rest, fraction, normal))
+            {
+                pos += rest;
+                break;
+            }
+            // stop at the impact, what is left of the move slides along the surface
+            type = MapQuery::CT_Ground;
+            pos += rest * fraction;
+            rest *= 1 - fraction;
+            rest -= normal * dot_product(rest, normal);
+            // blocked at 0 every step otherwise, while the velocity keeps growing
+            if (velocity)
+                *velocity -= normal * min(0.0f, dot_product(*velocity, normal));
+        }
+        suggest = pos;
+        return type;
+    }
+    Phy2d::Space *world;
+};
+
+#endif//SPACE_MAP_H
@@ -0,0 +1,80 @@
+#ifndef STATE_HASH_H
+#define STATE_HASH_H
+
+#include <cstring>
+#include "phy2d.h"
+
+namespace Phy2d
+{
+    /*
+    32 bit FNV-1a hash over the bits of the simulation state.
+    Two runs fed the same input must produce the same hash every frame, so
+    comparing it (or sending it along with a lockstep frame) finds the first
+    frame where a replay or a peer went its own way. Floats are hashed by
+    their bits, 0 and -0 differ.
+    */
+    class StateHash
+    {
+    public:
+        static const unsigned int Basis = 2166136261u;
+        static const unsigned int Prime = 16777619u;
+
+        StateHash() : hash(Basis)
+        {
+        }
+        void Reset()
+        {
+            hash = Basis;
+        }
+        unsigned int Get() const
+        {
+            return hash;
+        }
+        void Add(const void *data, size_t size)
+        {
+            const unsigned char *p = static_cast<const unsigned char *>(data);
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= p[i];
+                hash *= Prime;
+            }
+        }
+        void Add(unsigned int value)
+        {
+            Add(&value, sizeof(value));
+        }
+        void Add(int value)
+        {
+            Add(&value, sizeof(value));
+        }
+        void Add(bool value)
+        {
+            Add(value ? 1u : 0u);
+        }
+        void Add(float value)
+        {
+            unsigned int bits;
+            memcpy(&bits, &value, sizeof(bits));
+            Add(bits);
+        }
+        void Add(const vector2 &v)
+        {
+            Add(v.x);
+            Add(v.y);
+        }
+        /// type, shape and bounding box of a line segment or an arc
+        void Add(const Geom &geom)
+        {
+            Add(int(geom.GetType()));
+            Add(geom.GetVector2(0));
+            Add(geom.GetVector2(1));
+            Add(geom.GetFloat(0));
+            Add(geom.GetBBox().vmin);
+            Add(geom.GetBBox().vmax);
+        }
+    protected:
+        unsigned int hash;
+    };
+}
+
+#endif//STATE_HASH_H
@@ -0,0 +1,109 @@
+#ifndef SWEEP_AND_PRUNE_H
+#define SWEEP_AND_PRUNE_H
+
+#include <set>
+#include <vector>
+#include "moveObject.h"
+
+using namespace std;
+
+/// receives the pair events of SweepAndPrune
+class PairListener
+{
+public:
+    /// the bounding boxes of a and b started to overlap
+    virtual void OnPairAdded(MoveObject * /*a*/, MoveObject * /*b*/)
+    {
+    }
+    /// the bounding boxes of a and b no longer overlap
+    virtual void OnPairRemoved(MoveObject * /*a*/, MoveObject * /*b*/)
+    {
+    }
+};
+
+/**
+Sort and sweep broadphase for MoveObject against MoveObject.
+
+The box of every object (pos +- radius) is kept as sorted begin/end points on
+both axes. Update re-reads the positions and restores the order with an
+insertion sort, which costs little when objects move a bit each frame. Every
+swap of a begin point with an end point starts or ends an overlap on that
+axis, so the set of overlapping pairs is kept up to date without pair tests.
+*/
+class SweepAndPrune
+{
+public:
+    struct Pair
+    {
+        Pair(int a, int b) : a(min(a, b)), b(max(a, b))
+        {
+        }
+        bool operator < (const Pair &other) const
+        {
+            return a < other.a || (a == other.a && b < other.b);
+        }
+        int a, b;   // proxy ids, a < b
+    };
+    typedef set<Pair> PairSet;
+
+    SweepAndPrune() : listener(0), margin(0)
+    {
+    }
+    void SetListener(PairListener *listener)
+    {
+        this->listener = listener;
+    }
+    /// boxes are grown by 'margin', pairs are then reported a bit before the circles touch
+    void SetMargin(float margin)
+    {
+        this->margin = margin;
+    }
+
+    /// start tracking an object, return its proxy id
+    int Add(MoveObject *object);
+    /// stop tracking, reports the removal of all its pairs
+    void Remove(MoveObject *object);
+    /// re-read the positions and report the changed pairs
+    void Update();
+    void Clear();
+
+    const PairSet &GetPairs() const
+    {
+        return pairs;
+    }
+    MoveObject *GetObject(int proxy) const
+    {
+        return proxies[proxy].object;
+    }
+    /// proxy ids run from 0 to GetProxyCount() - 1, GetObject is 0 for the free ones
+    int GetProxyCount() const
+    {
+        return int(proxies.size());
+    }
+protected:
+    struct Proxy
+    {
+        MoveObject *object;   // 0 when the proxy is free
+        float lo[2], hi[2];
+    };
+    struct EndPoint
+    {
+        float value;
+        int proxy;
+        bool isBegin;
+    };
+    void SetBounds(Proxy &proxy);
+    bool Overlap(int a, int b) const;
+    void SortAxis(int axis);
+    void AddPair(int a, int b);
+    void RemovePair(int a, int b);
+
+    vector<Proxy> proxies;
+    vector<int> freeProxies;
+    vector<EndPoint> endPoints[2];
+    PairSet pairs;
+    PairListener *listener;
+    float margin;
+};
+
+#endif//SWEEP_AND_PRUNE_H
@@ -0,0 +1,197 @@
+#ifndef TYPED_SPACE_H
+#define TYPED_SPACE_H
+
+#include "phy2d.h"
+
+namespace Phy2d
+{
+    /// end of a TypeList
+    struct NullType
+    {
+    };
+    /// compile time list of geom types, e.g. TypeList<LineSegmentGeom, TypeList<ArcGeom> >
+    template <class H, class T = NullType>
+    struct TypeList
+    {
+        typedef H Head;
+        typedef T Tail;
+    };
+
+    /*
+    One array per geom type of List. Every listed type needs a StaticType
+    enum matching its GetType(); geoms of types not in the list go to the
+    last, generic bucket.
+    The queries call the listed types' functions qualified, so the compiler
+    knows the target and there is no virtual dispatch in the loop. Every geom
+    that reports contacts appends (geom index, count of contacts so far) to 'hits'.
+    The narrow phase tests and contacts go to 'stats'.
+    */
+    template <class List>
+    class GeomBuckets
+    {
+    public:
+        typedef typename List::Head Type;
+
+        void Add(GeomPtr geom, size_t index)
+        {
+            if (geom->GetType() == int(Type::StaticType))
+            {
+                geoms.push_back(static_cast<Type *>(geom));
+                indices.push_back(index);
+            }
+            else
+                rest.Add(geom, index);
+        }
+        void Clear()
+        {
+            geoms.clear();
+            indices.clear();
+            rest.Clear();
+        }
+        void QueryRay(const vector2 &from, const vector2 &to, ContactVector &collideinfo, vector<size_t> &hits, QueryStats &stats) const
+        {
+            const Geom::GeomType type = Geom::GeomType(Type::StaticType);
+            for (size_t i = 0; i < geoms.size(); i++)
+            {
+                size_t before = collideinfo.GetCount();
+                stats.CountNarrow(type);
+                if (geoms[i]->Type::CollisionRay(from, to, collideinfo))
+                {
+                    stats.CountContacts(type, collideinfo.GetCount() - before);
+                    hits.push_back(indices[i]);
+                    hits.push_back(collideinfo.GetCount());
+                }
+            }
+            rest.QueryRay(from, to, collideinfo, hits, stats);
+        }
+        void QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactVector &collideinfo, vector<size_t> &hits, QueryStats &stats) const
+        {
+            const Geom::GeomType type = Geom::GeomType(Type::StaticType);
+            for (size_t i = 0; i < geoms.size(); i++)
+            {
+                size_t before = collideinfo.GetCount();
+                stats.CountNarrow(type);
+                if (geoms[i]->Type::CollisionCircle(radius, from, to, collideinfo))
+                {
+                    stats.CountContacts(type, collideinfo.GetCount() - before);
+                    hits.push_back(indices[i]);
+                    hits.push_back(collideinfo.GetCount());
+                }
+            }
+            rest.QueryCircle(radius, from, to, collideinfo, hits, stats);
+        }
+    protected:
+        vector<Type *> geoms;
+        vector<size_t> indices;     // index of geoms[i] in the space
+        GeomBuckets<typename List::Tail> rest;
+    };
+
+    /// the generic bucket, virtual calls
+    template <>
+    class GeomBuckets<NullType>
+    {
+    public:
+        void Add(GeomPtr geom, size_t index)
+        {
+            geoms.push_back(geom);
+            indices.push_back(index);
+        }
+        void Clear()
+        {
+            geoms.clear();
+            indices.clear();
+        }
+        void QueryRay(const vector2 &from, const vector2 &to, ContactVector &collideinfo, vector<size_t> &hits, QueryStats &stats) const
+        {
+            for (size_t i = 0; i < geoms.size(); i++)
+            {
+                if (stats.CollisionRay(geoms[i], from, to, collideinfo))
+                {
+                    hits.push_back(indices[i]);
+                    hits.push_back(collideinfo.GetCount());
+                }
+            }
+        }
+        void QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactVector &collideinfo, vector<size_t> &hits, QueryStats &stats) const
+        {
+            for (size_t i = 0; i < geoms.size(); i++)
+            {
+                if (stats.CollisionCircle(geoms[i], radius, from, to, collideinfo))
+                {
+                    hits.push_back(indices[i]);
+                    hits.push_back(collideinfo.GetCount());
+                }
+            }
+        }
+    protected:
+        vector<GeomPtr> geoms;
+        vector<size_t> indices;
+    };
+
+    /// pass context.contacts to 'collideinfo' in the order the geoms were added,
+    /// context.candidates holding the hits as filled by GeomBuckets. Returns the geom
+    /// of the last contact, 0 if none
+    GeomPtr SortHitsByGeom(const vector<GeomPtr> &geoms, QueryContext &context, ContactSink &collideinfo);
+
+    /*
+    Space keeping its geoms grouped by type, e.g.
+        TypedSpace<TypeList<LineSegmentGeom, TypeList<ArcGeom> > >
+    Each query runs a tight loop over each type's array instead of calling
+    through a virtual function for every geom. The contacts are then put back
+    into the order the geoms were added, so the results are those of Space's
+    linear scan. Geoms are read in place, moving them needs no Update.
+    */
+    template <class List>
+    class TypedSpace : public Space
+    {
+    public:
+        virtual bool QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+        {
+            QueryStats::Scope count(context.stats);
+            context.candidates.clear();
+            context.contacts.clear();
+            ContactVector found(context.contacts);
+            buckets.QueryRay(from, to, found, context.candidates, context.stats);
+            return Finish(collideinfo, hit, context);
+        }
+        virtual bool QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+        {
+            QueryStats::Scope count(context.stats);
+            context.candidates.clear();
+            context.contacts.clear();
+            ContactVector found(context.contacts);
+            buckets.QueryCircle(radius, from, to, found, context.candidates, context.stats);
+            return Finish(collideinfo, hit, context);
+        }
+        virtual bool Update()
+        {
+            for (vector<GeomPtr>::iterator g = newgeoms.begin(); g != newgeoms.end(); ++g)
+            {
+                buckets.Add(*g, geoms.size());
+                geoms.push_back(*g);
+            }
+            newgeoms.clear();
+            return false;
+        }
+        virtual void Clear()
+        {
+            Space::Clear();
+            buckets.Clear();
+        }
+    protected:
+        bool Finish(ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+        {
+            if (context.candidates.empty())
+                return false;
+            hit = SortHitsByGeom(geoms, context, collideinfo);
+            return true;
+        }
+
+        GeomBuckets<List> buckets;
+    };
+
+    /// the geom types of a level
+    typedef TypedSpace<TypeList<LineSegmentGeom, TypeList<ArcGeom> > > LevelSpace;
+}
+
+#endif//TYPED_SPACE_H
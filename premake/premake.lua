@@ -1,4 +1,28 @@
 -- target Ԥ,ʾ뻷
+addoption("deterministic", "Build with PHY2D_DETERMINISTIC, for replays and lockstep games")
+addoption("profile", "Build with PROFILER_ENABLED and PHY2D_STATS, the frame profiler and query stats in release builds too")
+
+-- defines and build options the addoptions above ask for
+function setoptions(package)
+  package.defines = {}
+  if (options["profile"]) then
+    table.insert(package.defines, "PROFILER_ENABLED")
+    table.insert(package.defines, "PHY2D_STATS")
+  end
+  -- bit identical simulation on every machine, for replays and lockstep games:
+  -- deterministic trig and strict float math, SSE2 instead of x87, no fused multiply-add
+  if (options["deterministic"]) then
+    table.insert(package.defines, "PHY2D_DETERMINISTIC")
+    if (target == "vs2003") then
+      package.buildoptions = { "/Op", "/arch:SSE2" }
+    elseif (target == "gnu") then
+      package.buildoptions = { "-msse2", "-mfpmath=sse", "-ffp-contract=off" }
+    else
+      package.buildoptions = { "/fp:strict", "/arch:SSE2" }
+    end
+  end
+end
+
 project.path = "../build/" .. target
 project.name = "matchman"
 project.bindir = "../bin"
@@ -26,8 +50,82 @@ package.config["Debug"].links = { "hge", "hgehelp" }
 package.config["Release"].links = { "hge", "hgehelp" }
 package.includepaths = { "../../include", "../../include/ca", "../../include/hge" }
 
+setoptions(package)
+
 package.libpaths = { "../../lib", "../../lib/" .. target } 
 
 package.files = {
   matchrecursive("../../include/*.h", "../../src/*.cpp", "../../src/*.h")
 }
+
+-----------------------------
+-- headless simulation runner, no hge
+-----------------------------
+package = newpackage()
+
+package.path = project.path
+package.kind = "exe"
+package.name = "headless"
+package.language = "c++"
+package.bindir = "../../bin"
+
+package.config["Debug"].objdir = "./Debug/headless"
+package.config["Debug"].target = package.name .. "_d"
+package.config["Release"].objdir = "./Release/headless"
+package.config["Release"].target = package.name
+
+package.buildflags = {"extra-warnings", "static-runtime", "no-exceptions", "no-rtti" }
+package.includepaths = { "../../include", "../../tools/common" }
+setoptions(package)
+
+package.files = {
+  matchfiles("../../tools/headless/*.cpp"),
+  "../../src/phy2d.cpp",
+  "../../src/vector2.cpp",
+  "../../src/quadTreeSpace.cpp",
+  "../../src/sweepAndPrune.cpp",
+  "../../src/levelGenerator.cpp",
+  "../../src/simWorld.cpp",
+  "../../src/profiler.cpp",
+  "../../src/moverStore.cpp",
+  "../../src/parallelQuery.cpp",
+  "../../src/contactSolver.cpp",
+  "../../src/rigidBody.cpp"
+}
+-- the worker threads of ParallelQuery
+if (target == "gnu") then
+  package.links = { "pthread" }
+end
+
+-----------------------------
+-- microbenchmarks of the Phy2d primitives and spaces, no hge
+-----------------------------
+package = newpackage()
+
+package.path = project.path
+package.kind = "exe"
+package.name = "bench"
+package.language = "c++"
+package.bindir = "../../bin"
+
+package.config["Debug"].objdir = "./Debug/bench"
+package.config["Debug"].target = package.name .. "_d"
+package.config["Release"].objdir = "./Release/bench"
+package.config["Release"].target = package.name
+
+package.buildflags = {"extra-warnings", "static-runtime", "no-exceptions", "no-rtti" }
+package.includepaths = { "../../include", "../../tools/common" }
+setoptions(package)
+
+package.files = {
+  matchfiles("../../tools/bench/*.cpp"),
+  "../../src/phy2d.cpp",
+  "../../src/vector2.cpp",
+  "../../src/quadTreeSpace.cpp",
+  "../../src/gridSpace.cpp",
+  "../../src/bvhSpace.cpp",
+  "../../src/dynamicTree.cpp",
+  "../../src/dynamicTreeSpace.cpp",
+  "../../src/segmentSpace.cpp",
+  "../../src/typedSpace.cpp"
+}
@@ -0,0 +1,411 @@
+#include <cassert>
+#include "bvhSpace.h"
+
+namespace Phy2d
+{
+static float HalfPerimeter(const bbox2 &box)
+{
+    return (box.vmax.x - box.vmin.x) + (box.vmax.y - box.vmin.y);
+}
+
+static void SetEmpty(bbox2 &box)
+{
+    box.vmin.set(FLT_MAX, FLT_MAX);
+    box.vmax.set(-FLT_MAX, -FLT_MAX);
+}
+
+static float GetAxis(const vector2 &v, int axis)
+{
+    return axis == 0 ? v.x : v.y;
+}
+
+/// does the segment from 'from' to 'to' pass through 'box'
+static bool SegmentOverlap(const bbox2 &box, const vector2 &from, const vector2 &to)
+{
+    float t0 = 0, t1 = 1;
+    for (int axis = 0; axis < 2; axis++)
+    {
+        float p = GetAxis(from, axis);
+        float d = GetAxis(to, axis) - p;
+        float lo = GetAxis(box.vmin, axis), hi = GetAxis(box.vmax, axis);
+        if (d == 0)
+        {
+            if (p < lo || p > hi)
+                return false;
+            continue;
+        }
+        float ta = (lo - p) / d, tb = (hi - p) / d;
+        if (ta > tb)
+            swap(ta, tb);
+        t0 = max(t0, ta);
+        t1 = min(t1, tb);
+        if (t0 > t1)
+            return false;
+    }
+    return true;
+}
+
+/// sorts geom indices to the left side of a binned split
+struct BinLess
+{
+    BinLess(const vector<vector2> &centers, int axis, float lo, float scale, int split) :
+        centers(centers), axis(axis), lo(lo), scale(scale), split(split)
+    {
+    }
+    bool operator () (int index) const
+    {
+        int bin = int((GetAxis(centers[index], axis) - lo) * scale);
+        return bin <= split;
+    }
+    const vector<vector2> &centers;
+    int axis;
+    float lo, scale;
+    int split;
+};
+
+/// orders geom indices by box center along one axis
+struct CenterLess
+{
+    CenterLess(const vector<vector2> &centers, int axis) : centers(centers), axis(axis)
+    {
+    }
+    bool operator () (int a, int b) const
+    {
+        return GetAxis(centers[a], axis) < GetAxis(centers[b], axis);
+    }
+    const vector<vector2> &centers;
+    int axis;
+};
+
+BVHSpace::BVHSpace(float rebuildRatio) : buildCost(0), rebuildRatio(rebuildRatio)
+{
+    assert(rebuildRatio >= 1.0f);
+}
+
+void BVHSpace::Build(int node, int begin, int end, int depth)
+{
+    bbox2 box, centerBox;
+    SetEmpty(box);
+    SetEmpty(centerBox);
+    for (int i = begin; i < end; i++)
+    {
+        box.extend(geoms[order[i]]->GetBBox());
+        centerBox.extend(centers[order[i]]);
+    }
+    nodes[node].box = box;
+    nodes[node].left = nodes[node].right = -1;
+    nodes[node].first = begin;
+    nodes[node].count = end - begin;
+
+    int count = end - begin;
+    if (count <= MaxLeafSize || depth >= MaxDepth)
+        return;
+
+    vector2 extent = centerBox.size();
+    int axis = extent.x >= extent.y ? 0 : 1;
+    float lo = GetAxis(centerBox.vmin, axis);
+    float length = GetAxis(extent, axis);
+    if (length <= 0)
+        return; // all centers coincide, nothing to split by
+
+    // bin the centers and find the cheapest split between two bins
+    float scale = NumBins * (1.0f - 1e-5f) / length;
+    int binCount[NumBins];
+    bbox2 binBox[NumBins];
+    for (int b = 0; b < NumBins; b++)
+    {
+        binCount[b] = 0;
+        SetEmpty(binBox[b]);
+    }
+    for (int i = begin; i < end; i++)
+    {
+        int b = min(int((GetAxis(centers[order[i]], axis) - lo) * scale), NumBins - 1);
+        binCount[b]++;
+        binBox[b].extend(geoms[order[i]]->GetBBox());
+    }
+    float rightCost[NumBins];
+    bbox2 acc;
+    SetEmpty(acc);
+    int accCount = 0;
+    for (int b = NumBins - 1; b > 0; b--)
+    {
+        acc.extend(binBox[b]);
+        accCount += binCount[b];
+        rightCost[b] = accCount ? accCount * HalfPerimeter(acc) : 0;
+    }
+    SetEmpty(acc);
+    accCount = 0;
+    int bestSplit = -1;
+    float bestCost = FLT_MAX;
+    for (int b = 0; b < NumBins - 1; b++)
+    {
+        acc.extend(binBox[b]);
+        accCount += binCount[b];
+        if (accCount == 0 || accCount == count)
+            continue;
+        float cost = accCount * HalfPerimeter(acc) + rightCost[b + 1];
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestSplit = b;
+        }
+    }
+    // a leaf is cheaper to test than the split, keep it unless it gets too big
+    if (bestCost >= count * HalfPerimeter(box) && count <= MaxLeafSize * 4)
+        return;
+
+    int mid = begin;
+    if (bestSplit >= 0)
+        mid = int(partition(order.begin() + begin, order.begin() + end, BinLess(centers, axis, lo, scale, bestSplit)) - order.begin());
+    if (mid == begin || mid == end)
+    {
+        mid = (begin + end) / 2;
+        nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, CenterLess(centers, axis));
+    }
+
+    int left = int(nodes.size());
+    nodes.resize(nodes.size() + 2);
+    nodes[node].left = left;
+    nodes[node].right = left + 1;
+    nodes[node].count = 0;
+    Build(left, begin, mid, depth + 1);
+    Build(left + 1, mid, end, depth + 1);
+}
+
+void BVHSpace::Rebuild()
+{
+    nodes.clear();
+    order.resize(geoms.size());
+    centers.resize(geoms.size());
+    for (size_t i = 0; i < geoms.size(); i++)
+    {
+        order[i] = int(i);
+        centers[i] = geoms[i]->GetBBox().center();
+    }
+    if (!geoms.empty())
+    {
+        nodes.reserve(geoms.size() * 2);
+        nodes.resize(1);
+        Build(0, 0, int(geoms.size()), 0);
+    }
+    buildCost = GetCost();
+}
+
+void BVHSpace::Refit()
+{
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        Node &n = nodes[i];
+        if (n.count > 0)
+        {
+            n.box = geoms[order[n.first]]->GetBBox();
+            for (int j = n.first + 1; j < n.first + n.count; j++)
+                n.box.extend(geoms[order[j]]->GetBBox());
+        }
+        else
+        {
+            n.box = nodes[n.left].box;
+            n.box.extend(nodes[n.right].box);
+        }
+    }
+}
+
+float BVHSpace::GetCost() const
+{
+    float cost = 0;
+    for (vector<Node>::const_iterator n = nodes.begin(); n != nodes.end(); ++n)
+        cost += HalfPerimeter(n->box);
+    return cost;
+}
+
+bool BVHSpace::Update()
+{
+    bool rebuild = !newgeoms.empty();
+    geoms.insert(geoms.end(), newgeoms.begin(), newgeoms.end());
+    newgeoms.clear();
+
+    bool moved = false;
+    for (vector<GeomPtr>::iterator g = geoms.begin(); g != geoms.end(); ++g)
+    {
+        if ((*g)->GetDirty())
+            moved = true;
+    }
+    if (rebuild)
+        Rebuild();
+    else if (moved)
+    {
+        Refit();
+        if (GetCost() > buildCost * rebuildRatio)
+            Rebuild();
+    }
+    // the tree always covers every geom, nothing to hand over
+    return false;
+}
+
+void BVHSpace::Clear()
+{
+    Space::Clear();
+    nodes.clear();
+    order.clear();
+    centers.clear();
+    buildCost = 0;
+}
+
+void BVHSpace::GatherBox(const bbox2 &bound, QueryContext &context) const
+{
+    vector<size_t> &candidates = context.candidates;
+    candidates.clear();
+    if (nodes.empty())
+        return;
+    int stack[MaxDepth + 2];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node &n = nodes[stack[--top]];
+        if (!BoxOverlap(n.box, bound))
+            continue;
+        if (n.count > 0)
+        {
+            for (int i = n.first; i < n.first + n.count; i++)
+            {
+                if (context.stats.CountBox(BoxOverlap(geoms[order[i]]->GetBBox(), bound)))
+                    candidates.push_back(order[i]);
+            }
+        }
+        else
+        {
+            stack[top++] = n.right;
+            stack[top++] = n.left;
+        }
+    }
+}
+
+void BVHSpace::GatherRay(const vector2 &from, const vector2 &to, QueryContext &context) const
+{
+    vector<size_t> &candidates = context.candidates;
+    candidates.clear();
+    if (nodes.empty())
+        return;
+    int stack[MaxDepth + 2];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node &n = nodes[stack[--top]];
+        if (!SegmentOverlap(n.box, from, to))
+            continue;
+        if (n.count > 0)
+        {
+            for (int i = n.first; i < n.first + n.count; i++)
+            {
+                if (context.stats.CountBox(SegmentOverlap(geoms[order[i]]->GetBBox(), from, to)))
+                    candidates.push_back(order[i]);
+            }
+        }
+        else
+        {
+            stack[top++] = n.right;
+            stack[top++] = n.left;
+        }
+    }
+}
+
+static void SortCandidates(vector<size_t> &candidates)
+{
+    sort(candidates.begin(), candidates.end());
+}
+
+bool BVHSpace::QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    vector<size_t> &candidates = context.candidates;
+    GatherRay(from, to, context);
+    SortCandidates(candidates);
+    bool found = false;
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+        if (context.stats.CollisionRay(geoms[*c], from, to, collideinfo))
+        {
+            hit = geoms[*c];
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool BVHSpace::QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    if (nodes.empty())
+        return false;
+    ClosestRayHit closest(from, to, context.stats);
+    int stack[MaxDepth + 2];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node &n = nodes[stack[--top]];
+        // test against the ray clipped at the best hit so far
+        if (!SegmentOverlap(n.box, from, closest.GetEnd()))
+            continue;
+        if (n.count > 0)
+        {
+            for (int i = n.first; i < n.first + n.count; i++)
+                closest.Test(geoms[order[i]]);
+        }
+        else
+        {
+            // nearer child first, its hits clip the ray for the other one
+            vector2 dl = nodes[n.left].box.center() - from;
+            vector2 dr = nodes[n.right].box.center() - from;
+            bool leftFirst = dl.x * dl.x + dl.y * dl.y <= dr.x * dr.x + dr.y * dr.y;
+            stack[top++] = leftFirst ? n.right : n.left;
+            stack[top++] = leftFirst ? n.left : n.right;
+        }
+    }
+    if (!closest.Found())
+        return false;
+    hit = closest.GetHit();
+    return true;
+}
+
+bool BVHSpace::QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    vector<size_t> &candidates = context.candidates;
+    GatherBox(SweepBox(from, to, radius + CircleContactTolerance), context);
+    SortCandidates(candidates);
+    bool found = false;
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+        if (context.stats.CollisionCircle(geoms[*c], radius, from, to, collideinfo))
+        {
+            hit = geoms[*c];
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool BVHSpace::QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    vector<size_t> &candidates = context.candidates;
+    GatherBox(SweepBox(from, to, radius + CircleContactTolerance), context);
+    SortCandidates(candidates);
+    ClosestSweepHit closest(radius, from, to, context.stats);
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+        closest.Test(geoms[*c]);
+    if (!closest.Found())
+        return false;
+    hit = closest.GetHit();
+    return true;
+}
+
+void BVHSpace::CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const
+{
+    CollisionCircleBatchPerQuery(batch, out);
+}
+
+}
@@ -0,0 +1,70 @@
+#include <cmath>
+#include <cassert>
+#include "contactSolver.h"
+
+namespace Phy2d
+{
+    void ContactSolver::WarmStart(CollisionInfo *contacts, size_t count, const CollisionInfo *previous, size_t numPrevious)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            contacts[i].force = 0;
+            for (size_t j = 0; j < numPrevious; j++)
+            {
+                if (previous[j].geom == contacts[i].geom && previous[j].feature == contacts[i].feature)
+                {
+                    contacts[i].force = previous[j].force;
+                    break;
+                }
+            }
+        }
+    }
+
+    namespace
+    {
+        /// direction contact 'ci' pushes the circle per unit of force: its normal and the friction
+        inline vector2 PushDirection(const CollisionInfo &ci, const vector2 &velocity, float frictionMu)
+        {
+            vector2 friction = -velocity + ci.normal * dot_product(velocity, ci.normal);
+            friction.norm();
+            return ci.normal + friction * frictionMu;
+        }
+    }
+
+    int ContactSolver::Solve(CollisionInfo *contacts, size_t count, const vector2 &velocity, vector2 &force, float &total) const
+    {
+        assert(maxIterations > 0);
+        float limit = tolerance * force.len();
+        for (size_t i = 0; i < count; i++)
+        {
+            contacts[i].force = max(0.0f, contacts[i].force);
+            force += PushDirection(contacts[i], velocity, frictionMu) * contacts[i].force;
+        }
+        int iterations = 0;
+        while (iterations < maxIterations)
+        {
+            iterations++;
+            float change = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                // the friction is perpendicular to the normal, a unit of force along
+                // PushDirection takes one unit off the push into the contact
+                CollisionInfo &ci = contacts[i];
+                float f = max(0.0f, ci.force - dot_product(ci.normal, force));
+                float delta = f - ci.force;
+                if (delta != 0)
+                {
+                    force += PushDirection(ci, velocity, frictionMu) * delta;
+                    ci.force = f;
+                    change = max(change, float(fabs(delta)));
+                }
+            }
+            if (change <= limit)
+                break;
+        }
+        total = 0;
+        for (size_t i = 0; i < count; i++)
+            total += contacts[i].force;
+        return iterations;
+    }
+}
@@ -0,0 +1,332 @@
+#include "dynamicTree.h"
+
+namespace Phy2d
+{
+static float Perimeter(const bbox2 &box)
+{
+    return 2.0f * ((box.vmax.x - box.vmin.x) + (box.vmax.y - box.vmin.y));
+}
+
+static bbox2 Combine(const bbox2 &a, const bbox2 &b)
+{
+    bbox2 box(a);
+    box.extend(b);
+    return box;
+}
+
+DynamicTree::DynamicTree(float margin, float displacementMultiplier) :
+    root(NullNode), freeList(NullNode), proxyCount(0),
+    margin(margin), displacementMultiplier(displacementMultiplier)
+{
+}
+
+void DynamicTree::Clear()
+{
+    nodes.clear();
+    root = NullNode;
+    freeList = NullNode;
+    proxyCount = 0;
+}
+
+int DynamicTree::AllocateNode()
+{
+    int node;
+    if (freeList != NullNode)
+    {
+        node = freeList;
+        freeList = nodes[node].parent;
+    }
+    else
+    {
+        node = int(nodes.size());
+        nodes.push_back(TreeNode());
+    }
+    TreeNode &n = nodes[node];
+    n.parent = NullNode;
+    n.child1 = NullNode;
+    n.child2 = NullNode;
+    n.height = 0;
+    n.userData = -1;
+    return node;
+}
+
+void DynamicTree::FreeNode(int node)
+{
+    assert(node >= 0 && node < int(nodes.size()));
+    nodes[node].parent = freeList;
+    nodes[node].height = -1;
+    freeList = node;
+}
+
+int DynamicTree::CreateProxy(const bbox2 &box, int userData)
+{
+    int proxyId = AllocateNode();
+    TreeNode &n = nodes[proxyId];
+    n.box.vmin = box.vmin - vector2(margin, margin);
+    n.box.vmax = box.vmax + vector2(margin, margin);
+    n.userData = userData;
+    InsertLeaf(proxyId);
+    proxyCount++;
+    return proxyId;
+}
+
+void DynamicTree::DestroyProxy(int proxyId)
+{
+    assert(nodes[proxyId].IsLeaf());
+    RemoveLeaf(proxyId);
+    FreeNode(proxyId);
+    proxyCount--;
+}
+
+bool DynamicTree::MoveProxy(int proxyId, const bbox2 &box, const vector2 &displacement)
+{
+    assert(nodes[proxyId].IsLeaf());
+    if (BoxContains(nodes[proxyId].box, box))
+        return false;
+
+    RemoveLeaf(proxyId);
+
+    // grow the new fat box in the direction of the move, the next moves probably go the same way
+    bbox2 fat;
+    fat.vmin = box.vmin - vector2(margin, margin);
+    fat.vmax = box.vmax + vector2(margin, margin);
+    vector2 d = displacement * displacementMultiplier;
+    if (d.x < 0)
+        fat.vmin.x += d.x;
+    else
+        fat.vmax.x += d.x;
+    if (d.y < 0)
+        fat.vmin.y += d.y;
+    else
+        fat.vmax.y += d.y;
+    nodes[proxyId].box = fat;
+
+    InsertLeaf(proxyId);
+    return true;
+}
+
+void DynamicTree::InsertLeaf(int leaf)
+{
+    if (root == NullNode)
+    {
+        root = leaf;
+        nodes[root].parent = NullNode;
+        return;
+    }
+
+    // find the best sibling, the one whose box grows least
+    bbox2 leafBox = nodes[leaf].box;
+    int index = root;
+    while (!nodes[index].IsLeaf())
+    {
+        int child1 = nodes[index].child1;
+        int child2 = nodes[index].child2;
+
+        float area = Perimeter(nodes[index].box);
+        float combinedArea = Perimeter(Combine(nodes[index].box, leafBox));
+
+        // cost of creating a new parent for this node and the new leaf
+        float cost = 2.0f * combinedArea;
+        // minimum cost of pushing the leaf further down the tree
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        float cost1 = Perimeter(Combine(leafBox, nodes[child1].box)) + inheritanceCost;
+        if (!nodes[child1].IsLeaf())
+            cost1 -= Perimeter(nodes[child1].box);
+        float cost2 = Perimeter(Combine(leafBox, nodes[child2].box)) + inheritanceCost;
+        if (!nodes[child2].IsLeaf())
+            cost2 -= Perimeter(nodes[child2].box);
+
+        if (cost < cost1 && cost < cost2)
+            break;
+        index = cost1 < cost2 ? child1 : child2;
+    }
+    int sibling = index;
+
+    // create a new parent
+    int oldParent = nodes[sibling].parent;
+    int newParent = AllocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = Combine(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+
+    if (oldParent != NullNode)
+    {
+        if (nodes[oldParent].child1 == sibling)
+            nodes[oldParent].child1 = newParent;
+        else
+            nodes[oldParent].child2 = newParent;
+    }
+    else
+        root = newParent;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    // walk back up fixing heights and boxes
+    index = nodes[leaf].parent;
+    while (index != NullNode)
+    {
+        index = Balance(index);
+
+        int child1 = nodes[index].child1;
+        int child2 = nodes[index].child2;
+        assert(child1 != NullNode && child2 != NullNode);
+        nodes[index].height = 1 + max(nodes[child1].height, nodes[child2].height);
+        nodes[index].box = Combine(nodes[child1].box, nodes[child2].box);
+
+        index = nodes[index].parent;
+    }
+}
+
+void DynamicTree::RemoveLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = NullNode;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent != NullNode)
+    {
+        // destroy the parent and connect the sibling to the grand parent
+        if (nodes[grandParent].child1 == parent)
+            nodes[grandParent].child1 = sibling;
+        else
+            nodes[grandParent].child2 = sibling;
+        nodes[sibling].parent = grandParent;
+        FreeNode(parent);
+
+        int index = grandParent;
+        while (index != NullNode)
+        {
+            index = Balance(index);
+
+            int child1 = nodes[index].child1;
+            int child2 = nodes[index].child2;
+            nodes[index].box = Combine(nodes[child1].box, nodes[child2].box);
+            nodes[index].height = 1 + max(nodes[child1].height, nodes[child2].height);
+
+            index = nodes[index].parent;
+        }
+    }
+    else
+    {
+        root = sibling;
+        nodes[sibling].parent = NullNode;
+        FreeNode(parent);
+    }
+}
+
+/// rotate A up if it is unbalanced, return the node now at A's position
+int DynamicTree::Balance(int iA)
+{
+    assert(iA != NullNode);
+    if (nodes[iA].IsLeaf() || nodes[iA].height < 2)
+        return iA;
+
+    int iB = nodes[iA].child1;
+    int iC = nodes[iA].child2;
+    int balance = nodes[iC].height - nodes[iB].height;
+
+    // rotate C up
+    if (balance > 1)
+    {
+        int iF = nodes[iC].child1;
+        int iG = nodes[iC].child2;
+
+        // swap A and C
+        nodes[iC].child1 = iA;
+        nodes[iC].parent = nodes[iA].parent;
+        nodes[iA].parent = iC;
+
+        // A's old parent should point to C
+        if (nodes[iC].parent != NullNode)
+        {
+            if (nodes[nodes[iC].parent].child1 == iA)
+                nodes[nodes[iC].parent].child1 = iC;
+            else
+                nodes[nodes[iC].parent].child2 = iC;
+        }
+        else
+            root = iC;
+
+        // rotate
+        if (nodes[iF].height > nodes[iG].height)
+        {
+            nodes[iC].child2 = iF;
+            nodes[iA].child2 = iG;
+            nodes[iG].parent = iA;
+            nodes[iA].box = Combine(nodes[iB].box, nodes[iG].box);
+            nodes[iC].box = Combine(nodes[iA].box, nodes[iF].box);
+            nodes[iA].height = 1 + max(nodes[iB].height, nodes[iG].height);
+            nodes[iC].height = 1 + max(nodes[iA].height, nodes[iF].height);
+        }
+        else
+        {
+            nodes[iC].child2 = iG;
+            nodes[iA].child2 = iF;
+            nodes[iF].parent = iA;
+            nodes[iA].box = Combine(nodes[iB].box, nodes[iF].box);
+            nodes[iC].box = Combine(nodes[iA].box, nodes[iG].box);
+            nodes[iA].height = 1 + max(nodes[iB].height, nodes[iF].height);
+            nodes[iC].height = 1 + max(nodes[iA].height, nodes[iG].height);
+        }
+        return iC;
+    }
+
+    // rotate B up
+    if (balance < -1)
+    {
+        int iD = nodes[iB].child1;
+        int iE = nodes[iB].child2;
+
+        // swap A and B
+        nodes[iB].child1 = iA;
+        nodes[iB].parent = nodes[iA].parent;
+        nodes[iA].parent = iB;
+
+        // A's old parent should point to B
+        if (nodes[iB].parent != NullNode)
+        {
+            if (nodes[nodes[iB].parent].child1 == iA)
+                nodes[nodes[iB].parent].child1 = iB;
+            else
+                nodes[nodes[iB].parent].child2 = iB;
+        }
+        else
+            root = iB;
+
+        // rotate
+        if (nodes[iD].height > nodes[iE].height)
+        {
+            nodes[iB].child2 = iD;
+            nodes[iA].child1 = iE;
+            nodes[iE].parent = iA;
+            nodes[iA].box = Combine(nodes[iC].box, nodes[iE].box);
+            nodes[iB].box = Combine(nodes[iA].box, nodes[iD].box);
+            nodes[iA].height = 1 + max(nodes[iC].height, nodes[iE].height);
+            nodes[iB].height = 1 + max(nodes[iA].height, nodes[iD].height);
+        }
+        else
+        {
+            nodes[iB].child2 = iE;
+            nodes[iA].child1 = iD;
+            nodes[iD].parent = iA;
+            nodes[iA].box = Combine(nodes[iC].box, nodes[iD].box);
+            nodes[iB].box = Combine(nodes[iA].box, nodes[iE].box);
+            nodes[iA].height = 1 + max(nodes[iC].height, nodes[iD].height);
+            nodes[iB].height = 1 + max(nodes[iA].height, nodes[iE].height);
+        }
+        return iB;
+    }
+
+    return iA;
+}
+
+}
@@ -0,0 +1,169 @@
+#include "dynamicTreeSpace.h"
+
+namespace Phy2d
+{
+DynamicTreeSpace::DynamicTreeSpace(float margin, float displacementMultiplier) :
+    tree(margin, displacementMultiplier), numReinserted(0)
+{
+}
+
+void DynamicTreeSpace::OnGeomMoved(GeomPtr geom)
+{
+    moved.push_back(geom);
+}
+
+bool DynamicTreeSpace::Update()
+{
+    for (vector<GeomPtr>::iterator g = newgeoms.begin(); g != newgeoms.end(); ++g)
+    {
+        (*g)->GetDirty();
+        int proxy = tree.CreateProxy((*g)->GetBBox(), int(geoms.size()));
+        (*g)->SetSpace(this, proxy);
+        geoms.push_back(*g);
+        boxes.push_back((*g)->GetBBox());
+    }
+    newgeoms.clear();
+
+    numReinserted = 0;
+    for (vector<GeomPtr>::iterator g = moved.begin(); g != moved.end(); ++g)
+    {
+        if ((*g)->GetSpace() != this)
+            continue;
+        (*g)->GetDirty();
+        int proxy = (*g)->GetSpaceProxy();
+        int index = tree.GetUserData(proxy);
+        const bbox2 &box = (*g)->GetBBox();
+        if (tree.MoveProxy(proxy, box, box.center() - boxes[index].center()))
+            numReinserted++;
+        boxes[index] = box;
+    }
+    moved.clear();
+    return false;
+}
+
+void DynamicTreeSpace::Clear()
+{
+    for (vector<GeomPtr>::iterator g = geoms.begin(); g != geoms.end(); ++g)
+        (*g)->SetSpace(0, -1);
+    Space::Clear();
+    tree.Clear();
+    boxes.clear();
+    moved.clear();
+}
+
+/// collects the geoms whose box overlaps 'box' while the tree is walked
+struct DynamicTreeSpace::Gather
+{
+    Gather(const DynamicTreeSpace &space, const bbox2 &box, QueryContext &context) :
+        space(space), box(box), candidates(context.candidates), stats(context.stats)
+    {
+        candidates.clear();
+    }
+    bool QueryCallback(int proxyId)
+    {
+        int index = space.tree.GetUserData(proxyId);
+        if (stats.CountBox(BoxOverlap(space.geoms[index]->GetBBox(), box)))
+            candidates.push_back(index);
+        return true;
+    }
+    float RayCastCallback(int proxyId, float maxFraction)
+    {
+        QueryCallback(proxyId);
+        return maxFraction;
+    }
+    const DynamicTreeSpace &space;
+    bbox2 box;
+    vector<size_t> &candidates;
+    QueryStats &stats;
+};
+
+bool DynamicTreeSpace::QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    vector<size_t> &candidates = context.candidates;
+    Gather gather(*this, SweepBox(from, to, 0), context);
+    tree.RayCast(&gather, from, to);
+    sort(candidates.begin(), candidates.end());
+    bool found = false;
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+        if (context.stats.CollisionRay(geoms[*c], from, to, collideinfo))
+        {
+            hit = geoms[*c];
+            found = true;
+        }
+    }
+    return found;
+}
+
+/// tests the geoms as the tree reaches them and clips the tree's ray at the best hit
+struct DynamicTreeSpace::Closest
+{
+    Closest(const DynamicTreeSpace &space, const vector2 &from, const vector2 &to, QueryStats &stats) :
+        space(space), closest(from, to, stats)
+    {
+    }
+    float RayCastCallback(int proxyId, float maxFraction)
+    {
+        closest.Test(space.geoms[space.tree.GetUserData(proxyId)]);
+        if (!closest.Found())
+            return maxFraction;
+        // a little past the hit, an equally near geom must still be reached; 0 would stop the walk
+        return max(closest.GetHit().fraction * 1.001f + 0.0001f, 0.0001f);
+    }
+    const DynamicTreeSpace &space;
+    ClosestRayHit closest;
+};
+
+bool DynamicTreeSpace::QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    Closest callback(*this, from, to, context.stats);
+    tree.RayCast(&callback, from, to);
+    if (!callback.closest.Found())
+        return false;
+    hit = callback.closest.GetHit();
+    return true;
+}
+
+bool DynamicTreeSpace::QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    vector<size_t> &candidates = context.candidates;
+    Gather gather(*this, SweepBox(from, to, radius + CircleContactTolerance), context);
+    tree.Query(&gather, gather.box);
+    sort(candidates.begin(), candidates.end());
+    bool found = false;
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+        if (context.stats.CollisionCircle(geoms[*c], radius, from, to, collideinfo))
+        {
+            hit = geoms[*c];
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool DynamicTreeSpace::QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    vector<size_t> &candidates = context.candidates;
+    Gather gather(*this, SweepBox(from, to, radius + CircleContactTolerance), context);
+    tree.Query(&gather, gather.box);
+    sort(candidates.begin(), candidates.end());
+    ClosestSweepHit closest(radius, from, to, context.stats);
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+        closest.Test(geoms[*c]);
+    if (!closest.Found())
+        return false;
+    hit = closest.GetHit();
+    return true;
+}
+
+void DynamicTreeSpace::CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const
+{
+    CollisionCircleBatchPerQuery(batch, out);
+}
+
+}
@@ -1,5 +1,6 @@
 
 #include "gamestate.h"
+#include "profiler.h"
 
 #include <cassert>
 
@@ -66,6 +67,9 @@ void GameStateManager::RequestState(const string &name)
 
 bool GameStateManager::OnFrame()
 {
+    // a frame is this and the render after it
+    PROFILE_NEXT_FRAME();
+    PROFILE_ZONE("GameStateManager::OnFrame");
     if (!requestState.empty())
     {
         if (curState)
@@ -91,6 +95,7 @@ bool FrameFunc()
 
 bool RenderFunc()
 {
+    PROFILE_ZONE("RenderFunc");
     GameState *gs = GameStateManager::Instance()->curState;
     if (gs)
     {
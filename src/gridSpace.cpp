@@ -0,0 +1,368 @@
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include "gridSpace.h"
+
+namespace Phy2d
+{
+const int DefaultMaxCellsPerGeom = 64;
+
+GridSpace::GridSpace(const bbox2 &area, float cellSize) :
+    hashed(false), cellSize(cellSize), invCellSize(1.0f / cellSize), origin(area.vmin),
+    maxCellsPerGeom(DefaultMaxCellsPerGeom)
+{
+    assert(cellSize > 0);
+    vector2 size = area.size();
+    width = max(1, int(ceil(size.x * invCellSize)));
+    height = max(1, int(ceil(size.y * invCellSize)));
+    buckets.resize(size_t(width) * size_t(height));
+}
+
+GridSpace::GridSpace(float cellSize, size_t numBuckets) :
+    hashed(true), cellSize(cellSize), invCellSize(1.0f / cellSize), width(0), height(0),
+    maxCellsPerGeom(DefaultMaxCellsPerGeom)
+{
+    assert(cellSize > 0);
+    assert(numBuckets > 0);
+    buckets.resize(numBuckets);
+}
+
+size_t GridSpace::GetBucket(int x, int y) const
+{
+    if (hashed)
+    {
+        unsigned int h = (unsigned int)(x) * 73856093u ^ (unsigned int)(y) * 19349663u;
+        return h % buckets.size();
+    }
+    assert(x >= 0 && x < width && y >= 0 && y < height);
+    return size_t(y) * size_t(width) + size_t(x);
+}
+
+GridSpace::CellRange GridSpace::GetCellRange(const bbox2 &box) const
+{
+    CellRange r;
+    r.x0 = CellX(box.vmin.x);
+    r.y0 = CellY(box.vmin.y);
+    r.x1 = CellX(box.vmax.x);
+    r.y1 = CellY(box.vmax.y);
+    r.overflow = float(r.x1 - r.x0 + 1) * float(r.y1 - r.y0 + 1) > float(maxCellsPerGeom);
+    if (!hashed && (r.x0 < 0 || r.y0 < 0 || r.x1 >= width || r.y1 >= height))
+        r.overflow = true;
+    return r;
+}
+
+/// clamp a cell range to the grid, return false if nothing is left
+bool GridSpace::ClampRange(int &x0, int &y0, int &x1, int &y1) const
+{
+    if (hashed)
+        return true;
+    x0 = max(x0, 0);
+    y0 = max(y0, 0);
+    x1 = min(x1, width - 1);
+    y1 = min(y1, height - 1);
+    return x0 <= x1 && y0 <= y1;
+}
+
+void GridSpace::Insert(size_t index)
+{
+    CellRange &r = ranges[index];
+    r = GetCellRange(geoms[index]->GetBBox());
+    if (r.overflow)
+    {
+        overflow.push_back(index);
+        return;
+    }
+    for (int y = r.y0; y <= r.y1; y++)
+    {
+        for (int x = r.x0; x <= r.x1; x++)
+            buckets[GetBucket(x, y)].push_back(index);
+    }
+}
+
+static void RemoveOne(vector<size_t> &list, size_t index)
+{
+    vector<size_t>::iterator i = find(list.begin(), list.end(), index);
+    assert(i != list.end());
+    *i = list.back();
+    list.pop_back();
+}
+
+void GridSpace::Remove(size_t index)
+{
+    const CellRange &r = ranges[index];
+    if (r.overflow)
+    {
+        RemoveOne(overflow, index);
+        return;
+    }
+    for (int y = r.y0; y <= r.y1; y++)
+    {
+        for (int x = r.x0; x <= r.x1; x++)
+            RemoveOne(buckets[GetBucket(x, y)], index);
+    }
+}
+
+bool GridSpace::Update()
+{
+    for (vector<GeomPtr>::iterator g = newgeoms.begin(); g != newgeoms.end(); ++g)
+    {
+        (*g)->GetDirty();
+        geoms.push_back(*g);
+        ranges.push_back(CellRange());
+        Insert(geoms.size() - 1);
+    }
+    newgeoms.clear();
+    for (size_t i = 0; i < geoms.size(); i++)
+    {
+        if (geoms[i]->GetDirty())
+        {
+            CellRange r = GetCellRange(geoms[i]->GetBBox());
+            const CellRange &old = ranges[i];
+            if (r.x0 != old.x0 || r.y0 != old.y0 || r.x1 != old.x1 || r.y1 != old.y1 || r.overflow != old.overflow)
+            {
+                Remove(i);
+                Insert(i);
+            }
+        }
+    }
+    // geoms are rebucketed in place, nothing to hand over
+    return false;
+}
+
+void GridSpace::Clear()
+{
+    Space::Clear();
+    for (vector<vector<size_t> >::iterator b = buckets.begin(); b != buckets.end(); ++b)
+        b->clear();
+    overflow.clear();
+    ranges.clear();
+}
+
+void GridSpace::GatherCell(int x, int y, vector<size_t> &candidates) const
+{
+    if (!hashed && (x < 0 || x >= width || y < 0 || y >= height))
+        return;
+    const vector<size_t> &bucket = buckets[GetBucket(x, y)];
+    candidates.insert(candidates.end(), bucket.begin(), bucket.end());
+}
+
+void GridSpace::GatherRow(int y, int x0, int x1, vector<size_t> &candidates) const
+{
+    int y1 = y;
+    if (!ClampRange(x0, y, x1, y1))
+        return;
+    for (int x = x0; x <= x1; x++)
+        GatherCell(x, y, candidates);
+}
+
+void GridSpace::GatherAll(vector<size_t> &candidates) const
+{
+    for (size_t i = 0; i < geoms.size(); i++)
+        candidates.push_back(i);
+}
+
+/// visit the cells crossed by the line from 'from' to 'to', Amanatides & Woo style
+void GridSpace::GatherRay(vector2 from, vector2 to, vector<size_t> &candidates) const
+{
+    if (!hashed)
+    {
+        // clip to the grid first, cells outside hold nothing
+        vector2 lo = origin;
+        vector2 hi = origin + vector2(float(width), float(height)) * cellSize;
+        vector2 d = to - from;
+        float t0 = 0, t1 = 1;
+        float p[4] = { -d.x, d.x, -d.y, d.y };
+        float q[4] = { from.x - lo.x, hi.x - from.x, from.y - lo.y, hi.y - from.y };
+        for (int i = 0; i < 4; i++)
+        {
+            if (p[i] == 0)
+            {
+                if (q[i] < 0)
+                    return;
+                continue;
+            }
+            float t = q[i] / p[i];
+            if (p[i] < 0)
+                t0 = max(t0, t);
+            else
+                t1 = min(t1, t);
+        }
+        if (t0 > t1)
+            return;
+        vector2 clipFrom(from + d * t0), clipTo(from + d * t1);
+        from = clipFrom;
+        to = clipTo;
+    }
+    int x = CellX(from.x), y = CellY(from.y);
+    int endX = CellX(to.x), endY = CellY(to.y);
+    int steps = abs(endX - x) + abs(endY - y);
+    if (hashed && size_t(steps) >= buckets.size())
+    {
+        GatherAll(candidates);
+        return;
+    }
+
+    vector2 d = to - from;
+    int stepX = d.x > 0 ? 1 : -1;
+    int stepY = d.y > 0 ? 1 : -1;
+    float tDeltaX = d.x != 0 ? cellSize / fabs(d.x) : FLT_MAX;
+    float tDeltaY = d.y != 0 ? cellSize / fabs(d.y) : FLT_MAX;
+    float tMaxX = FLT_MAX, tMaxY = FLT_MAX;
+    if (d.x != 0)
+        tMaxX = (origin.x + float(x + (stepX > 0 ? 1 : 0)) * cellSize - from.x) / d.x;
+    if (d.y != 0)
+        tMaxY = (origin.y + float(y + (stepY > 0 ? 1 : 0)) * cellSize - from.y) / d.y;
+
+    GatherCell(x, y, candidates);
+    for (; steps > 0; steps--)
+    {
+        // never walk past the end cell on an axis, rounding may disagree with CellX/CellY
+        if (x != endX && (tMaxX < tMaxY || y == endY))
+        {
+            x += stepX;
+            tMaxX += tDeltaX;
+        }
+        else
+        {
+            y += stepY;
+            tMaxY += tDeltaY;
+        }
+        GatherCell(x, y, candidates);
+    }
+}
+
+/// visit the cells touched by a circle of radius 'margin' moving from 'from' to 'to', row by row
+void GridSpace::GatherCircle(float margin, const vector2 &from, const vector2 &to, vector<size_t> &candidates) const
+{
+    int y0 = CellY(min(from.y, to.y) - margin);
+    int y1 = CellY(max(from.y, to.y) + margin);
+    int x0 = CellX(min(from.x, to.x) - margin);
+    int x1 = CellX(max(from.x, to.x) + margin);
+    if (hashed && float(x1 - x0 + 1) * float(y1 - y0 + 1) >= float(buckets.size()))
+    {
+        GatherAll(candidates);
+        return;
+    }
+    if (!ClampRange(x0, y0, x1, y1))
+        return;
+
+    // slack covers rounding between CellY and the row borders computed here
+    float slack = cellSize * 0.001f;
+    float dy = to.y - from.y;
+    for (int y = y0; y <= y1; y++)
+    {
+        float rowMin = origin.y + float(y) * cellSize - margin - slack;
+        float rowMax = origin.y + float(y + 1) * cellSize + margin + slack;
+        float t0 = 0, t1 = 1;
+        if (dy != 0)
+        {
+            float ta = (rowMin - from.y) / dy;
+            float tb = (rowMax - from.y) / dy;
+            if (ta > tb)
+                swap(ta, tb);
+            t0 = max(t0, ta);
+            t1 = min(t1, tb);
+            if (t0 > t1)
+                continue;
+        }
+        else if (from.y < rowMin || from.y > rowMax)
+            continue;
+        float xa = from.x + (to.x - from.x) * t0;
+        float xb = from.x + (to.x - from.x) * t1;
+        if (xa > xb)
+            swap(xa, xb);
+        GatherRow(y, CellX(xa - margin - slack), CellX(xb + margin + slack), candidates);
+    }
+}
+
+static void SortCandidates(vector<size_t> &candidates)
+{
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+}
+
+bool GridSpace::QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    vector<size_t> &candidates = context.candidates;
+    candidates.assign(overflow.begin(), overflow.end());
+    GatherRay(from, to, candidates);
+    SortCandidates(candidates);
+
+    bool found = false;
+    bbox2 bound = SweepBox(from, to, 0);
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+        GeomPtr g = geoms[*c];
+        if (context.stats.CountBox(BoxOverlap(g->GetBBox(), bound)) && context.stats.CollisionRay(g, from, to, collideinfo))
+        {
+            hit = g;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool GridSpace::QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    vector<size_t> &candidates = context.candidates;
+    candidates.assign(overflow.begin(), overflow.end());
+    GatherRay(from, to, candidates);
+    SortCandidates(candidates);
+
+    ClosestRayHit closest(from, to, context.stats);
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+        closest.Test(geoms[*c]);
+    if (!closest.Found())
+        return false;
+    hit = closest.GetHit();
+    return true;
+}
+
+bool GridSpace::QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    float margin = radius + CircleContactTolerance;
+    vector<size_t> &candidates = context.candidates;
+    candidates.assign(overflow.begin(), overflow.end());
+    GatherCircle(margin, from, to, candidates);
+    SortCandidates(candidates);
+
+    bool found = false;
+    bbox2 bound = SweepBox(from, to, margin);
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+        GeomPtr g = geoms[*c];
+        if (context.stats.CountBox(BoxOverlap(g->GetBBox(), bound)) && context.stats.CollisionCircle(g, radius, from, to, collideinfo))
+        {
+            hit = g;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool GridSpace::QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    vector<size_t> &candidates = context.candidates;
+    candidates.assign(overflow.begin(), overflow.end());
+    GatherCircle(radius + CircleContactTolerance, from, to, candidates);
+    SortCandidates(candidates);
+
+    ClosestSweepHit closest(radius, from, to, context.stats);
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+        closest.Test(geoms[*c]);
+    if (!closest.Found())
+        return false;
+    hit = closest.GetHit();
+    return true;
+}
+
+void GridSpace::CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const
+{
+    CollisionCircleBatchPerQuery(batch, out);
+}
+
+}
@@ -0,0 +1,152 @@
+#include <cmath>
+#include <cassert>
+
+#include "detMath.h"
+#include "levelGenerator.h"
+
+namespace
+{
+    const float Pi = 3.14159265f;
+
+    Phy2d::LineSegmentGeom *NewSegment(const vector2 &a, const vector2 &b)
+    {
+        Phy2d::LineSegmentGeom *segment = new Phy2d::LineSegmentGeom;
+        segment->SetLineSegment(a, b);
+        return segment;
+    }
+
+    Phy2d::ArcGeom *NewArc(const vector2 &center, const vector2 &arc, float radian)
+    {
+        Phy2d::ArcGeom *ag = new Phy2d::ArcGeom;
+        ag->SetArc(center, arc, radian);
+        return ag;
+    }
+
+    /// unit vector at 'angle', by det_sin/det_cos in every build: the CRT's would not give the same bits everywhere
+    vector2 Direction(float angle)
+    {
+        return vector2(det_cos(angle), det_sin(angle));
+    }
+
+    class Placer
+    {
+    public:
+        Placer(const LevelParams &params, LevelRandom &random) : params(params), random(random)
+        {
+            for (size_t i = 0; i < params.numClusters; i++)
+                clusters.push_back(InArea());
+        }
+        /// where the next geom goes
+        vector2 Position()
+        {
+            if (clusters.empty() || random.Uniform() >= params.clusterFraction)
+                return InArea();
+            const vector2 &center = clusters[random.Next() % clusters.size()];
+            // the distance is uniform, so the geoms crowd toward the middle
+            return center + Direction(random.Uniform(0, 2 * Pi)) * (params.clusterRadius * random.Uniform());
+        }
+        float Size()
+        {
+            // u^sizeSkew by multiplying, pow would not give the same bits everywhere
+            float u = random.Uniform();
+            float t = 1;
+            for (int i = 0; i < params.sizeSkew; i++)
+                t *= u;
+            return params.minSize + (params.maxSize - params.minSize) * t;
+        }
+        vector2 InArea()
+        {
+            const bbox2 &area = params.area;
+            return vector2(random.Uniform(area.vmin.x, area.vmax.x), random.Uniform(area.vmin.y, area.vmax.y));
+        }
+        /// a point on the border of the area
+        vector2 OnBorder()
+        {
+            const bbox2 &area = params.area;
+            vector2 p = InArea();
+            switch (random.Next() % 4)
+            {
+            case 0: p.x = area.vmin.x; break;
+            case 1: p.x = area.vmax.x; break;
+            case 2: p.y = area.vmin.y; break;
+            default: p.y = area.vmax.y; break;
+            }
+            return p;
+        }
+    protected:
+        const LevelParams &params;
+        LevelRandom &random;
+        vector<vector2> clusters;
+    };
+}
+
+LevelParams::LevelParams() :
+    seed(1),
+    area(vector2(400, 250), vector2(390, 250)),
+    numSegments(5),
+    numArcs(5),
+    minSize(10),
+    maxSize(210),
+    sizeSkew(1),
+    maxTilt(0.12f),
+    minArcAngle(0.1f * Pi),
+    maxArcAngle(0.9f * Pi),
+    numClusters(0),
+    clusterFraction(0.5f),
+    clusterRadius(100),
+    numSpanning(0),
+    numNests(0),
+    nestDepth(8)
+{
+}
+
+size_t LevelParams::GetGeomCount() const
+{
+    return numSegments + numArcs + numSpanning + numNests * nestDepth;
+}
+
+void LevelParams::SetDensity(float geomsPerSquare)
+{
+    assert(geomsPerSquare > 0);
+    float side = 100.0f * sqrt(GetGeomCount() / geomsPerSquare);
+    area.set(area.center(), vector2(side, side) * 0.5f);
+}
+
+void GenerateLevel(const LevelParams &params, vector<Phy2d::GeomPtr> &out)
+{
+    assert(params.minSize > 0 && params.minSize <= params.maxSize && params.sizeSkew >= 1);
+    assert(params.minArcAngle > 0 && params.minArcAngle <= params.maxArcAngle);
+    LevelRandom random(params.seed);
+    Placer placer(params, random);
+    out.reserve(out.size() + params.GetGeomCount());
+
+    for (size_t i = 0; i < params.numSegments; i++)
+    {
+        vector2 center = placer.Position();
+        vector2 half = Direction(random.Uniform(-params.maxTilt, params.maxTilt)) * placer.Size();
+        out.push_back(NewSegment(center - half, center + half));
+    }
+    for (size_t i = 0; i < params.numArcs; i++)
+    {
+        vector2 center = placer.Position();
+        vector2 arc = center + Direction(random.Uniform(0, 2 * Pi)) * placer.Size();
+        out.push_back(NewArc(center, arc, random.Uniform(params.minArcAngle, params.maxArcAngle)));
+    }
+    // long segments crossing most of the area, they overlap every broadphase cell on their way
+    for (size_t i = 0; i < params.numSpanning; i++)
+    {
+        out.push_back(NewSegment(placer.OnBorder(), placer.OnBorder()));
+    }
+    // arcs around the same center, their boxes all overlap each other
+    for (size_t i = 0; i < params.numNests; i++)
+    {
+        vector2 center = placer.Position();
+        vector2 axis = Direction(random.Uniform(0, 2 * Pi));
+        float step = (params.maxSize - params.minSize) / params.nestDepth;
+        for (size_t j = 0; j < params.nestDepth; j++)
+        {
+            float radius = params.minSize + step * (j + 1);
+            out.push_back(NewArc(center, center + axis * radius, random.Uniform(params.minArcAngle, params.maxArcAngle)));
+        }
+    }
+}
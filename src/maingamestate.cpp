@@ -12,41 +12,24 @@ vector2 mousepos;
 void MainGameState::OnEnter()
 {
     assert(!fnt);
-    srand(GetTickCount());
     HGE *hge = hgeCreate(HGE_VERSION);
     assert(hge);
     fnt = new hgeFont("font1.fnt");
     player.Load();
     hge->Release();
     player.font = fnt;
-    world.AddGeom(CreateLineSegment(vector2(0, 500), vector2(800, 500)));
-    world.AddGeom(CreateLineSegment(vector2(10, 0), vector2(10, 500)));
-    world.AddGeom(CreateLineSegment(vector2(790, 0), vector2(790, 500)));
-
-    world.AddGeom(CreateLineSegment(vector2(550, 0), vector2(550, 400)));
-    world.AddGeom(CreateLineSegment(vector2(600, 0), vector2(600, 400)));
-
-    world.AddGeom(CreateLineSegment(vector2(20, 400), vector2(100, 450)));
-    world.AddGeom(CreateLineSegment(vector2(100, 400), vector2(20, 450)));
-
-    const float Pi = acos(-1.0f);
-    float x, y, len, dHeight;
-    for (int i = 0; i < 5; i++)
-    {
-        x = float(rand() % 780);
-        y = float(rand() % 500);
-        len = float(rand() % 200 + 10);
-        dHeight = float(rand() % 100 - 50);
-        world.AddGeom(CreateLineSegment(vector2(x - len, y), vector2(x + len, y + dHeight)));
-    }
-    for (int i = 0; i < 5; i++)
+    sim.BuildLevel(GetTickCount());
+    player.font = fnt;
+    sim.AddMover(&player);
+    if (crowdSize > 0)
     {
-        x = float(rand() % 780 + 10);
-        y = float(rand() % 500);
-        world.AddGeom(CreateArc(vector2(x, y), vector2(x + rand()%100 - 50, y + rand()%100 - 50), rand()%10 * 0.1f * Pi));
+        sim.SetNumThreads(numThreads);
+        sim.AddCrowd(crowdSize, GetTickCount());
     }
-    player.SetMapQuery(&this->map);
-    player.font = fnt;
+    accumulator = 0;
+    subSteps = 0;
+    queryStats.Reset();
+    sim.GetSpace().ResetStats();
 #if 0
     x = rand() % 500 + 200;
     y = rand() % 500;
@@ -54,33 +37,13 @@ void MainGameState::OnEnter()
 #endif
 }
 
-Phy2d::LineSegmentGeom* MainGameState::CreateLineSegment(const vector2 &a, const vector2 &b)
-{
-    Phy2d::LineSegmentGeom *lsg = new Phy2d::LineSegmentGeom;
-    lsg->SetLineSegment(a, b);
-    geoms.push_back(lsg);
-    return lsg;
-}
-
-Phy2d::ArcGeom* MainGameState::CreateArc(const vector2 &center, const vector2 &arc, float radian)
-{
-    Phy2d::ArcGeom *ag = new Phy2d::ArcGeom;
-    ag->SetArc(center, arc, radian);
-    geoms.push_back(ag);
-    return ag;
-}
 void MainGameState::OnLeave()
 {
-    world.Clear();
-    for (vector<Phy2d::GeomPtr>::iterator g = geoms.begin(); g != geoms.end(); ++g)
-        delete *g;
-    geoms.clear();
+    sim.Clear();
 
     delete fnt;
     fnt = 0;
 }    
-#pragma comment(lib, "winmm")
-DWORD t1, t2, t3;
 void MainGameState::OnFrame()
 {
     HGE *hge = hgeCreate(HGE_VERSION);
@@ -93,17 +56,31 @@ void MainGameState::OnFrame()
     {
         RequestState("mainmenu");
     }
-    
-    t1 = timeGetTime();
+#ifdef PROFILER_ENABLED
+    if (hge->Input_KeyDown(HGEK_F9))
+        Profiler::Instance().WriteChromeTrace("profile.json");
+#endif
 
-    while(world.Update())
-        ;
 #if 0
     hge->Input_GetMousePos(&mousepos.x, &mousepos.y);
 #endif
-    t2 = timeGetTime();
-    player.OnFrame(delta);
-    t3 = timeGetTime();
+    accumulator += delta;
+    for (subSteps = 0; subSteps < maxSubSteps && accumulator >= stepTime; subSteps++)
+    {
+        sim.Step(stepTime);
+        stateHash = sim.HashWorld();
+        accumulator -= stepTime;
+    }
+    if (accumulator >= stepTime)
+    {
+        // too far behind, drop the whole steps that did not fit
+        accumulator = fmod(accumulator, stepTime);
+    }
+    if (subSteps > 0)
+    {
+        queryStats = sim.GetSpace().GetStats();
+        sim.GetSpace().ResetStats();
+    }
 
     //playerdata.vy = playerdata.vy * 0.9;
     hge->Release();
@@ -117,9 +94,36 @@ void MainGameState::OnRender()
     hge->Gfx_Clear(0);
     fnt->SetColor(0xFFFFFFFF);
     fnt->printf(5, 5, HGETEXT_LEFT, "dt:%.3f\nFPS:%d", hge->Timer_GetDelta(), hge->Timer_GetFPS());
+#ifdef PHY2D_STATS
+    fnt->printf(160, 5, HGETEXT_LEFT, "queries:%u box:%u/%u rejected\nnarrow:%u contacts:%u max:%u",
+        queryStats.GetQueries(), queryStats.GetBoxRejects(), queryStats.GetBoxTests(),
+        queryStats.GetNarrowTests(), queryStats.GetContacts(), queryStats.GetMaxContacts());
+#endif
     // world.RenderDebug();
-    this->map.Render();
-    player.Render();
+    {
+        PROFILE_ZONE("render map");
+        this->map.Render();
+    }
+    {
+        PROFILE_ZONE("render player");
+        player.Render(accumulator / stepTime);
+    }
+    {
+        PROFILE_ZONE("render crowd");
+        // a diamond each, thousands of them; the sleeping ones darker
+        const MoverStore &crowd = sim.GetCrowd();
+        float alpha = accumulator / stepTime;
+        for (size_t i = 0; i < crowd.GetCount(); i++)
+        {
+            vector2 p = crowd.GetRenderPosition(i, alpha);
+            float r = crowd.GetRadius(i);
+            DWORD color = crowd.HasFlag(i, MoverStore::Sleeping) ? 0xff406080 : 0xff80c0ff;
+            hge->Gfx_RenderLine(p.x - r, p.y, p.x, p.y - r, color);
+            hge->Gfx_RenderLine(p.x, p.y - r, p.x + r, p.y, color);
+            hge->Gfx_RenderLine(p.x + r, p.y, p.x, p.y + r, color);
+            hge->Gfx_RenderLine(p.x, p.y + r, p.x - r, p.y, color);
+        }
+    }
     char buf[100];
 #if 0
     vector2 col, normal;
@@ -137,8 +141,32 @@ void MainGameState::OnRender()
     }
 #endif
 
-    sprintf(buf, "%d %d", t3 - t2, t2 - t1);
+    sprintf(buf, "steps:%d hash:%08x", subSteps, stateHash);
     fnt->Render(0, 100, HGETEXT_LEFT, buf);
+#ifdef PROFILER_ENABLED
+    RenderProfile(5, 140);
+#endif
     hge->Gfx_EndScene();
     hge->Release();
 }
+
+#ifdef PROFILER_ENABLED
+void MainGameState::RenderProfile(float x, float y) const
+{
+    Profiler &profiler = Profiler::Instance();
+    if (profiler.GetFrameCount() == 0)
+        return;
+    float scale = fnt->GetScale();
+    fnt->SetScale(0.5f);
+    fnt->Render(x, y, HGETEXT_LEFT, "last frame, F9 writes profile.json");
+    const vector<Profiler::Zone> &zones = profiler.GetFrame(0);
+    char buf[100];
+    for (size_t i = 0; i < zones.size() && i < MaxProfileLines; i++)
+    {
+        const Profiler::Zone &z = zones[i];
+        sprintf(buf, "%*s%s %.3f ms", z.depth * 2, "", z.name, (z.end - z.begin) * 0.001);
+        fnt->Render(x, y + (i + 1) * fnt->GetHeight() * 0.5f, HGETEXT_LEFT, buf);
+    }
+    fnt->SetScale(scale);
+}
+#endif
@@ -22,6 +22,8 @@
 
 #include <cmath>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 
 
 // Pointer to the HGE interface.
@@ -32,7 +34,18 @@ HGE *hge=0;
 
 // Pointers to the HGE objects we will use
 
-int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
+/// the number after 'option' on the command line, or 'def' when it is not there
+static int GetIntOption(const char *cmdLine, const char *option, int def)
+{
+    const char *p = strstr(cmdLine, option);
+    if (!p)
+        return def;
+    return atoi(p + strlen(option));
+}
+
+// command line: -crowd n  AI matchmen moving with the player
+//               -threads n  threads the crowd moves on, 0 for one per core
+int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR cmdLine, int)
 {
     hge = hgeCreate(HGE_VERSION);
 
@@ -49,6 +62,8 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
     GameStateManager::Instance()->RegisterState(&mms);
     MainGameState mgs;
     mgs.SetName("maingame");
+    mgs.SetCrowdSize(GetIntOption(cmdLine, "-crowd", 0));
+    mgs.SetNumThreads(GetIntOption(cmdLine, "-threads", 0));
     GameStateManager::Instance()->RegisterState(&mgs);
     GameStateManager::Instance()->RequestState("mainmenu");
 
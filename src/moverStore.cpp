@@ -0,0 +1,507 @@
+#include <cmath>
+#include <cassert>
+
+#include "moverStore.h"
+#include "profiler.h"
+
+const float MoverStore::MinSlide = 1e-3f;
+const float MoverStore::SleepDistance = 0.5f;
+
+MoverStore::MoverStore() : gravity(0, 980), parallel(0), canSleep(true)
+{
+}
+
+size_t MoverStore::Add(const vector2 &pos, float radius, unsigned int seed)
+{
+    posX.push_back(pos.x);
+    posY.push_back(pos.y);
+    prevX.push_back(pos.x);
+    prevY.push_back(pos.y);
+    velX.push_back(0);
+    velY.push_back(0);
+    this->radius.push_back(radius);
+    flags.push_back(Ground);
+    buttons.push_back(0);
+    aiState.push_back(seed);
+    aiTicks.push_back(0);
+    idleSteps.push_back(0);
+    idleX.push_back(pos.x);
+    idleY.push_back(pos.y);
+    idleSupport.push_back(0);
+    warm.resize(warm.size() + MaxWarmContacts);
+    warmCount.push_back(0);
+    return posX.size() - 1;
+}
+
+void MoverStore::Clear()
+{
+    posX.clear();
+    posY.clear();
+    prevX.clear();
+    prevY.clear();
+    velX.clear();
+    velY.clear();
+    radius.clear();
+    flags.clear();
+    buttons.clear();
+    aiState.clear();
+    aiTicks.clear();
+    idleSteps.clear();
+    idleX.clear();
+    idleY.clear();
+    idleSupport.clear();
+    warm.clear();
+    warmCount.clear();
+}
+
+void MoverStore::SetCanSleep(bool canSleep)
+{
+    this->canSleep = canSleep;
+    if (!canSleep)
+    {
+        for (size_t i = 0; i < GetCount(); i++)
+            Wake(i);
+    }
+}
+
+void MoverStore::Wake(const bbox2 *areas, size_t count)
+{
+    for (size_t i = 0; i < GetCount(); i++)
+    {
+        if (!(flags[i] & Sleeping))
+            continue;
+        for (size_t a = 0; a < count; a++)
+        {
+            const bbox2 &area = areas[a];
+            if (posX[i] + radius[i] >= area.vmin.x && posX[i] - radius[i] <= area.vmax.x &&
+                posY[i] + radius[i] >= area.vmin.y && posY[i] - radius[i] <= area.vmax.y)
+            {
+                Wake(i);
+                break;
+            }
+        }
+    }
+}
+
+size_t MoverStore::GetSleepingCount() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < GetCount(); i++)
+    {
+        if (flags[i] & Sleeping)
+            count++;
+    }
+    return count;
+}
+
+void MoverStore::Step(float delta, const Phy2d::Space &space)
+{
+    PROFILE_ZONE("MoverStore::Step");
+    stats.Reset();
+    prevX = posX;
+    prevY = posY;
+    Think();
+    Accelerate(delta, space);
+    Query(space);
+    Move(delta, space);
+    Separate(space);
+}
+
+void MoverStore::Think()
+{
+    // every so many steps something new to do: mostly standing around, now and then
+    // a walk to the left or the right, maybe jumping
+    for (size_t i = 0; i < aiState.size(); i++)
+    {
+        if (aiTicks[i]-- > 0)
+            continue;
+        aiState[i] = aiState[i] * 1664525u + 1013904223u;
+        aiTicks[i] = int((aiState[i] >> 8) % 120) + 10;
+        aiState[i] = aiState[i] * 1664525u + 1013904223u;
+        unsigned int r = aiState[i] >> 8;
+        unsigned char down = 0;
+        if (r % 5 == 0)
+            down |= 1 << CharInput::Left;
+        if (r % 5 == 1)
+            down |= 1 << CharInput::Right;
+        if (r % 5 < 2 && (r >> 8) % 4 == 0)
+            down |= 1 << CharInput::Jump;
+        buttons[i] = down;
+        if (down)
+            Wake(i);
+    }
+}
+
+void MoverStore::Accelerate(float delta, const Phy2d::Space &space)
+{
+    PROFILE_ZONE("MoverStore::Accelerate");
+    awake.clear();
+    forceX.clear();
+    forceY.clear();
+    fromX.clear();
+    fromY.clear();
+    toX.clear();
+    toY.clear();
+    queryRadius.clear();
+    vector2 up = -gravity;
+    up.norm();
+    float jumpForce = gravity.len() + 100.0f;
+    context.stats.Reset();
+    for (size_t i = 0; i < GetCount(); i++)
+    {
+        if (flags[i] & Sleeping)
+            continue;
+        if ((flags[i] & Ground) && warmCount[i] > 0)
+        {
+            // ride along with the platform stood on, like CharSim
+            vector2 carry = Phy2d::SupportVelocity(&warm[i * MaxWarmContacts], warmCount[i]);
+            if (carry.x != 0 || carry.y != 0)
+            {
+                vector2 pos = Slide(space, radius[i], GetPosition(i), GetPosition(i) + carry * delta, context);
+                posX[i] = pos.x;
+                posY[i] = pos.y;
+            }
+        }
+        // the first half of CharSim::OnFrame
+        vector2 force;
+        if (IsDown(i, CharInput::Left))
+            force.x -= 200.0f;
+        if (IsDown(i, CharInput::Right))
+            force.x += 200.0f;
+        if ((flags[i] & (Ground | JumpHold)) == Ground && IsDown(i, CharInput::Jump))
+        {
+            force += up * jumpForce;
+            velY[i] -= 300;
+            flags[i] = JumpHold;
+        }
+        if (flags[i] & JumpHold)
+        {
+            if (IsDown(i, CharInput::Jump))
+            {
+                if (!(flags[i] & Ground))
+                    force -= gravity * 0.5f;
+            }
+            else
+                flags[i] &= ~JumpHold;
+        }
+        force += gravity;
+        awake.push_back(i);
+        forceX.push_back(force.x);
+        forceY.push_back(force.y);
+        fromX.push_back(posX[i]);
+        fromY.push_back(posY[i]);
+        toX.push_back(posX[i] + (velX[i] + force.x * delta) * delta);
+        toY.push_back(posY[i] + (velY[i] + force.y * delta) * delta);
+        queryRadius.push_back(radius[i]);
+    }
+    stats.Add(context.stats);
+}
+
+void MoverStore::Query(const Phy2d::Space &space)
+{
+    PROFILE_ZONE("MoverStore::Query");
+    Phy2d::CircleQueryBatch batch;
+    batch.count = awake.size();
+    if (batch.count == 0)
+        return;
+    batch.fromX = &fromX[0];
+    batch.fromY = &fromY[0];
+    batch.toX = &toX[0];
+    batch.toY = &toY[0];
+    batch.radius = &queryRadius[0];
+    contacts.context.stats.Reset();
+    if (parallel)
+        parallel->CollisionCircleBatch(space, batch, contacts);
+    else
+        space.CollisionCircleBatch(batch, contacts);
+    stats.Add(contacts.context.stats);
+}
+
+/// Move of the movers of one slice
+struct MoverStore::MoveJob : public Phy2d::ParallelJob
+{
+    MoveJob(MoverStore &store, float delta, const Phy2d::Space &space) : store(store), delta(delta), space(space)
+    {
+    }
+    virtual void Run(size_t begin, size_t end, int slice)
+    {
+        for (size_t k = begin; k < end; k++)
+            store.Move(k, delta, space, store.scratch[slice]);
+    }
+    MoverStore &store;
+    float delta;
+    const Phy2d::Space &space;
+private:
+    MoveJob &operator = (const MoveJob &);
+};
+
+void MoverStore::Move(float delta, const Phy2d::Space &space)
+{
+    PROFILE_ZONE("MoverStore::Move");
+    MoveJob job(*this, delta, space);
+    scratch.resize(parallel ? parallel->GetNumThreads() : 1);
+    for (size_t s = 0; s < scratch.size(); s++)
+        scratch[s].context.stats.Reset();
+    if (parallel)
+        parallel->Run(job, awake.size());
+    else
+        job.Run(0, awake.size(), 0);
+    for (size_t s = 0; s < scratch.size(); s++)
+        stats.Add(scratch[s].context.stats);
+}
+
+void MoverStore::Move(size_t k, float delta, const Phy2d::Space &space, Scratch &scratch)
+{
+    size_t i = awake[k];
+    vector2 pos(posX[i], posY[i]);
+    vector2 force(forceX[k], forceY[k]);
+    vector2 velocity(velX[i], velY[i]);
+    float supportForce = 0;
+    size_t count = contacts.GetCount(k);
+    if (count == 0)
+    {
+        flags[i] &= ~Ground;
+        warmCount[i] = 0;
+    }
+    else
+    {
+        // the support forces and the friction of CharSim::OnFrame
+        flags[i] |= Ground;
+        vector<Phy2d::CollisionInfo> &support = scratch.support;
+        support.assign(contacts.GetContacts(k), contacts.GetContacts(k) + count);
+        Phy2d::ContactSolver::WarmStart(&support[0], count, &warm[i * MaxWarmContacts], warmCount[i]);
+        vector2 tempForce = force;
+        float totalForce;
+        solver.Solve(&support[0], count, velocity, tempForce, totalForce);
+        for (vector<Phy2d::CollisionInfo>::iterator ci = support.begin(); ci != support.end(); ++ci)
+        {
+            float depth = ci->depth - 0.005f;
+            if (depth > 0)
+            {
+                if (totalForce > 0 && ci->force < totalForce)
+                    pos += ci->normal * (depth * ci->force / totalForce);
+                else
+                    pos += ci->normal * depth;
+            }
+            velocity = velocity - ci->normal * dot_product(ci->normal, velocity);
+        }
+        force = tempForce;
+        supportForce = totalForce;
+        // the first contacts found are kept, the space visits the geoms in the same order every step
+        warmCount[i] = (unsigned char)min(count, size_t(MaxWarmContacts));
+        copy(support.begin(), support.begin() + warmCount[i], warm.begin() + i * MaxWarmContacts);
+    }
+    velocity += force * delta;
+    // swept, so a fast fall stops on thin geometry instead of passing through it
+    pos = Slide(space, radius[i], pos, pos + velocity * delta, scratch.context, &velocity);
+    velX[i] = velocity.x;
+    velY[i] = velocity.y;
+    posX[i] = pos.x;
+    posY[i] = pos.y;
+
+    // MoveObject::UpdateSleep
+    bool idle = flags[i] == Ground && buttons[i] == 0;
+    vector2 drift(pos.x - idleX[i], pos.y - idleY[i]);
+    if (canSleep && idle && drift.len() <= SleepDistance && fabs(supportForce - idleSupport[i]) <= 0.01f * idleSupport[i])
+    {
+        if (++idleSteps[i] >= SleepSteps)
+        {
+            flags[i] |= Sleeping;
+            velX[i] = 0;
+            velY[i] = 0;
+        }
+    }
+    else
+    {
+        idleSteps[i] = 0;
+        idleX[i] = pos.x;
+        idleY[i] = pos.y;
+        idleSupport[i] = supportForce;
+    }
+}
+
+vector2 MoverStore::Slide(const Phy2d::Space &space, float radius, const vector2 &from, const vector2 &to,
+    Phy2d::QueryContext &context, vector2 *velocity)
+{
+    vector2 pos = from;
+    vector2 rest = to - from;
+    for (int i = 0; i < MaxSlides; i++)
+    {
+        Phy2d::RayHit hit;
+        if (!space.QuerySweepCircle(radius, pos, pos + rest, hit, context))
+        {
+            pos += rest;
+            break;
+        }
+        pos += rest * hit.fraction;
+        rest *= 1 - hit.fraction;
+        rest -= hit.info.normal * dot_product(rest, hit.info.normal);
+        if (velocity)
+            *velocity -= hit.info.normal * min(0.0f, dot_product(*velocity, hit.info.normal));
+        // resting on the ground, what is left is too short to be worth another sweep
+        if (dot_product(rest, rest) < MinSlide * MinSlide)
+            break;
+    }
+    return pos;
+}
+
+/// ApplyPush of the movers of one slice
+struct MoverStore::PushJob : public Phy2d::ParallelJob
+{
+    PushJob(MoverStore &store, const Phy2d::Space &space) : store(store), space(space)
+    {
+    }
+    virtual void Run(size_t begin, size_t end, int slice)
+    {
+        for (size_t i = begin; i < end; i++)
+            store.ApplyPush(i, space, store.scratch[slice].context);
+    }
+    MoverStore &store;
+    const Phy2d::Space &space;
+private:
+    PushJob &operator = (const PushJob &);
+};
+
+void MoverStore::Separate(const Phy2d::Space &space)
+{
+    PROFILE_ZONE("MoverStore::Separate");
+    size_t n = GetCount();
+    if (n < 2)
+        return;
+    // hashed grid of cells as wide as the largest mover, overlapping movers are in neighbouring cells
+    float maxRadius = 0;
+    for (size_t i = 0; i < n; i++)
+        maxRadius = max(maxRadius, radius[i]);
+    float invCell = 1.0f / max(2 * maxRadius, 1e-3f);
+    size_t numCells = 1;
+    while (numCells < 2 * n)
+        numCells *= 2;
+    cellX.resize(n);
+    cellY.resize(n);
+    cellStart.assign(numCells + 1, 0);
+    for (size_t i = 0; i < n; i++)
+    {
+        cellX[i] = int(floor(posX[i] * invCell));
+        cellY[i] = int(floor(posY[i] * invCell));
+        cellStart[CellHash(cellX[i], cellY[i], numCells) + 1]++;
+    }
+    for (size_t c = 0; c < numCells; c++)
+        cellStart[c + 1] += cellStart[c];
+    // counting sort, every cell lists its movers by index
+    order.resize(n);
+    cellNext.assign(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < n; i++)
+        order[cellNext[CellHash(cellX[i], cellY[i], numCells)]++] = i;
+
+    pushX.assign(n, 0);
+    pushY.assign(n, 0);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t visited[9];
+        int numVisited = 0;
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                size_t c = CellHash(cellX[i] + dx, cellY[i] + dy, numCells);
+                // two neighbours may hash to the same cell, its pairs are handled once
+                bool seen = false;
+                for (int v = 0; v < numVisited && !seen; v++)
+                    seen = visited[v] == c;
+                if (seen)
+                    continue;
+                visited[numVisited++] = c;
+                for (size_t k = cellStart[c]; k < cellStart[c + 1]; k++)
+                {
+                    size_t j = order[k];
+                    if (j > i)
+                        Push(i, j);
+                }
+            }
+        }
+    }
+    // swept, a crowd pressing a mover against a wall must not push it through
+    PushJob job(*this, space);
+    scratch.resize(parallel ? parallel->GetNumThreads() : 1);
+    for (size_t s = 0; s < scratch.size(); s++)
+        scratch[s].context.stats.Reset();
+    if (parallel)
+        parallel->Run(job, n);
+    else
+        job.Run(0, n, 0);
+    for (size_t s = 0; s < scratch.size(); s++)
+        stats.Add(scratch[s].context.stats);
+}
+
+void MoverStore::ApplyPush(size_t i, const Phy2d::Space &space, Phy2d::QueryContext &context)
+{
+    if (pushX[i] == 0 && pushY[i] == 0)
+        return;
+    // stops at the first impact, sliding on would cost more sweeps for what a push is
+    vector2 push(pushX[i], pushY[i]);
+    Phy2d::RayHit hit;
+    if (space.QuerySweepCircle(radius[i], GetPosition(i), GetPosition(i) + push, hit, context))
+        push *= hit.fraction;
+    posX[i] += push.x;
+    posY[i] += push.y;
+}
+
+void MoverStore::Push(size_t i, size_t j)
+{
+    // SimWorld::ResolvePushes for one pair
+    vector2 d(posX[j] - posX[i], posY[j] - posY[i]);
+    float reach = radius[i] + radius[j];
+    float distSq = d.x * d.x + d.y * d.y;
+    if (distSq >= reach * reach)
+        return;
+    float dist = sqrt(distSq);
+    float overlap = reach - dist;
+    // a push that moves a sleeping mover more than it may drift wakes it
+    if (0.5f * overlap > SleepDistance)
+    {
+        Wake(i);
+        Wake(j);
+    }
+    if (dist > TINY)
+        d /= dist;
+    else
+        d.set(1, 0);
+    pushX[i] -= d.x * 0.5f * overlap;
+    pushY[i] -= d.y * 0.5f * overlap;
+    pushX[j] += d.x * 0.5f * overlap;
+    pushY[j] += d.y * 0.5f * overlap;
+    // cancel the approaching part of the velocities, shared equally
+    float vn = (velX[j] - velX[i]) * d.x + (velY[j] - velY[i]) * d.y;
+    if (vn < 0)
+    {
+        velX[i] += d.x * vn * 0.5f;
+        velY[i] += d.y * vn * 0.5f;
+        velX[j] -= d.x * vn * 0.5f;
+        velY[j] -= d.y * vn * 0.5f;
+    }
+}
+
+void MoverStore::HashState(Phy2d::StateHash &hash) const
+{
+    for (size_t i = 0; i < GetCount(); i++)
+    {
+        hash.Add(posX[i]);
+        hash.Add(posY[i]);
+        hash.Add(velX[i]);
+        hash.Add(velY[i]);
+        hash.Add(radius[i]);
+        hash.Add(unsigned(flags[i]));
+        hash.Add(aiState[i]);
+        hash.Add(idleSteps[i]);
+        hash.Add(idleX[i]);
+        hash.Add(idleY[i]);
+        hash.Add(idleSupport[i]);
+        hash.Add(unsigned(warmCount[i]));
+        for (size_t c = 0; c < warmCount[i]; c++)
+        {
+            hash.Add(warm[i * MaxWarmContacts + c].feature);
+            hash.Add(warm[i * MaxWarmContacts + c].force);
+        }
+    }
+}
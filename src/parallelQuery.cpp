@@ -0,0 +1,249 @@
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include <cassert>
+#include "parallelQuery.h"
+
+namespace Phy2d
+{
+/// auto reset event, Wait returns once for every Set
+class Signal
+{
+public:
+#ifdef _WIN32
+    Signal()
+    {
+        handle = CreateEvent(0, FALSE, FALSE, 0);
+    }
+    ~Signal()
+    {
+        CloseHandle(handle);
+    }
+    void Set()
+    {
+        SetEvent(handle);
+    }
+    void Wait()
+    {
+        WaitForSingleObject(handle, INFINITE);
+    }
+private:
+    HANDLE handle;
+#else
+    Signal() : signaled(false)
+    {
+        pthread_mutex_init(&mutex, 0);
+        pthread_cond_init(&cond, 0);
+    }
+    ~Signal()
+    {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+    void Set()
+    {
+        pthread_mutex_lock(&mutex);
+        signaled = true;
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+    }
+    void Wait()
+    {
+        pthread_mutex_lock(&mutex);
+        while (!signaled)
+            pthread_cond_wait(&cond, &mutex);
+        signaled = false;
+        pthread_mutex_unlock(&mutex);
+    }
+private:
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool signaled;
+#endif
+    Signal(const Signal &);
+    Signal &operator = (const Signal &);
+};
+
+struct ParallelQuery::Worker
+{
+    Worker(ParallelQuery *owner, int slice) : owner(owner), slice(slice), quit(false)
+    {
+    }
+    void Loop()
+    {
+        for (;;)
+        {
+            start.Wait();
+            if (quit)
+                break;
+            owner->RunSlice(slice);
+            done.Set();
+        }
+    }
+
+    ParallelQuery *owner;
+    int slice;
+    bool quit;
+    Signal start, done;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+};
+
+#ifdef _WIN32
+static unsigned __stdcall WorkerMain(void *arg)
+{
+    static_cast<ParallelQuery::Worker *>(arg)->Loop();
+    return 0;
+}
+#else
+static void *WorkerMain(void *arg)
+{
+    static_cast<ParallelQuery::Worker *>(arg)->Loop();
+    return 0;
+}
+#endif
+
+int ParallelQuery::GetNumCores()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int n = int(info.dwNumberOfProcessors);
+#else
+    int n = int(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+    return n > 0 ? n : 1;
+}
+
+ParallelQuery::ParallelQuery(int numThreads) :
+    numThreads(0), space(0), circles(0), rays(0), job(0), count(0), sliceSize(0), numSlices(0)
+{
+    SetNumThreads(numThreads);
+}
+
+ParallelQuery::~ParallelQuery()
+{
+    StopWorkers();
+}
+
+void ParallelQuery::SetNumThreads(int numThreads)
+{
+    assert(numThreads >= 0);
+    if (numThreads == 0)
+        numThreads = GetNumCores();
+    numThreads = min(numThreads, int(MaxThreads));
+    if (numThreads == this->numThreads)
+        return;
+    StopWorkers();
+    this->numThreads = numThreads;
+    parts.resize(numThreads);
+    StartWorkers();
+}
+
+void ParallelQuery::StartWorkers()
+{
+    for (int i = 1; i < numThreads; i++)
+    {
+        Worker *worker = new Worker(this, i);
+#ifdef _WIN32
+        worker->thread = (HANDLE)_beginthreadex(0, 0, WorkerMain, worker, 0, 0);
+        assert(worker->thread);
+#else
+        int result = pthread_create(&worker->thread, 0, WorkerMain, worker);
+        assert(result == 0);
+        (void)result;
+#endif
+        workers.push_back(worker);
+    }
+}
+
+void ParallelQuery::StopWorkers()
+{
+    for (vector<Worker *>::iterator w = workers.begin(); w != workers.end(); ++w)
+    {
+        (*w)->quit = true;
+        (*w)->start.Set();
+#ifdef _WIN32
+        WaitForSingleObject((*w)->thread, INFINITE);
+        CloseHandle((*w)->thread);
+#else
+        pthread_join((*w)->thread, 0);
+#endif
+        delete *w;
+    }
+    workers.clear();
+}
+
+void ParallelQuery::CollisionCircleBatch(const Space &space, const CircleQueryBatch &batch, ContactBuffer &out)
+{
+    this->space = &space;
+    circles = &batch;
+    rays = 0;
+    Run(batch.count, out);
+}
+
+void ParallelQuery::CollisionRayBatch(const Space &space, const RayQueryBatch &batch, ContactBuffer &out)
+{
+    this->space = &space;
+    circles = 0;
+    rays = &batch;
+    Run(batch.count, out);
+}
+
+void ParallelQuery::Run(ParallelJob &job, size_t count)
+{
+    this->job = &job;
+    RunSlices(count);
+    this->job = 0;
+}
+
+void ParallelQuery::Run(size_t count, ContactBuffer &out)
+{
+    RunSlices(count);
+    out.Assign(&parts[0], numSlices);
+    // every slice counted into its own buffer's stats
+    for (int i = 0; i < numSlices; i++)
+    {
+        out.context.stats.Add(parts[i].context.stats);
+        parts[i].context.stats.Reset();
+    }
+    space = 0;
+    circles = 0;
+    rays = 0;
+}
+
+void ParallelQuery::RunSlices(size_t count)
+{
+    // cut into equal slices, but no slice shorter than MinSliceSize
+    this->count = count;
+    size_t maxSlices = max(size_t(1), (count + MinSliceSize - 1) / MinSliceSize);
+    numSlices = int(min(size_t(numThreads), maxSlices));
+    sliceSize = (count + numSlices - 1) / numSlices;
+
+    for (int i = 1; i < numSlices; i++)
+        workers[i - 1]->start.Set();
+    RunSlice(0);
+    for (int i = 1; i < numSlices; i++)
+        workers[i - 1]->done.Wait();
+}
+
+void ParallelQuery::RunSlice(int slice)
+{
+    size_t begin = min(count, slice * sliceSize);
+    size_t end = min(count, begin + sliceSize);
+    if (job)
+        job->Run(begin, end, slice);
+    else if (circles)
+        space->CollisionCircleBatch(circles->Slice(begin, end), parts[slice]);
+    else
+        space->CollisionRayBatch(rays->Slice(begin, end), parts[slice]);
+}
+
+}
@@ -7,25 +7,21 @@ namespace Phy2d
 const float Pi = acos(-1.0f);
 float LineSegmentGeom::GetDistance(const vector2 &point, vector2 &shadow) const
 {
-    vector2 ab = b - a;
-    vector2 ap = point - a;
-    float f = dot_product(ab, ap);
-    if (f < 0)
-    {
+    return sqrt(GetDistanceSquared(point, shadow));
+}
+float LineSegmentGeom::GetDistanceSquared(const vector2 &point, vector2 &shadow) const
+{
+    float f = dot_product(ab, point - a) * invLenSq;
+    if (f <= 0)
         shadow = a;
-        return ap.len();
-    }
-    float d = dot_product(ab, ab);
-    if (f > d)
-    {
+    else if (f >= 1)
         shadow = b;
-        return (b - point).len();
-    }
-    f = f / d;
-    shadow.lerp(a, b, f);
-    return (shadow - point).len();
+    else
+        shadow = a + ab * f;
+    vector2 d = point - shadow;
+    return dot_product(d, d);
 }
-bool LineSegmentGeom::CollisionRay(const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+bool LineSegmentGeom::CollisionRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo)
 {
     // boundingbox test
     {
@@ -45,142 +41,154 @@ bool LineSegmentGeom::CollisionRay(const vector2 &from, const vector2 &to, vecto
         /*
         p = from + k * (to - from)
         */
-        float k = (cross_product(a, from) + cross_product(b, a) + cross_product(from, b)/* + cross_product(a, a)*/) /
-            (cross_product(to, a) + cross_product(a, from) + cross_product(b, to) + cross_product(from, b));
+        // relative to 'from', absolute coordinates would cancel out and cost most of the precision
+        float k = cross_product(a - from, b - a) / cross_product(to - from, b - a);
         CollisionInfo ci;
         ci.pos.lerp(from, to, k);
-        ci.normal = b - a;
-        ci.normal.norm();
-        swap(ci.normal.x, ci.normal.y);
+        ci.normal = normal;
         if (dot_product(ci.normal, from - ci.pos) < 0)
             ci.normal.x = -ci.normal.x, ci.normal.y = -ci.normal.y;
-        collideinfo.push_back(ci);
+        ci.geom = this;
+        collideinfo.AddContact(ci);
         return true;
     }
 
     return false;
 }
 
-bool LineSegmentGeom::CollisionCircle(float radius, const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+bool LineSegmentGeom::CollisionCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo)
 {
     assert(radius > 0);
     vector2 shadow;
-    if (GetDistance(from, shadow) <= radius + 0.005f && (to - shadow).len() < (from - shadow).len())
+    float limit = radius + CircleContactTolerance;
+    if (GetDistanceSquared(from, shadow) > limit * limit)
+        return false;
+    // only when moving closer
+    vector2 toShadow = to - shadow, fromShadow = from - shadow;
+    if (dot_product(toShadow, toShadow) < dot_product(fromShadow, fromShadow))
     {
         CollisionInfo ci;
         ci.normal = from - shadow;
         ci.depth = max(0.0f, radius - ci.normal.len());
         ci.normal.norm();
         ci.pos = shadow + ci.normal * (radius + 0.0025f);
-        collideinfo.push_back(ci);
+        ci.geom = this;
+        ci.feature = shadow == a ? CollisionInfo::FirstEnd : shadow == b ? CollisionInfo::SecondEnd : CollisionInfo::Face;
+        collideinfo.AddContact(ci);
         return true;
     }
     return false;
+}
 
-    bool flag = false;
-    vector2 tmpcollide;
-
-    vector2 normalRadius(b.y - a.y, a.x - b.x);
-    normalRadius.norm();
-    normalRadius *= radius;
+/// earliest t in [0, 1] at which a circle moving from 'from' along 'd' touches 'point'
+static bool SweepPoint(const vector2 &point, float radius, const vector2 &from, const vector2 &d, float &t, vector2 &normal)
+{
+    vector2 m = from - point;
+    float b = dot_product(m, d);
+    if (b >= 0)
+        return false; // not getting closer
+    float c = dot_product(m, m) - radius * radius;
+    if (c <= 0)
+    {
+        t = 0;
+        normal = m;
+        normal.norm();
+        return true;
+    }
+    float a = dot_product(d, d);
+    float discriminant = b * b - a * c;
+    if (discriminant < 0)
+        return false;
+    float root = (-b - sqrt(discriminant)) / a;
+    if (root > 1)
+        return false;
+    t = root;
+    normal = m + d * root;
+    normal.norm();
+    return true;
+}
 
-    LineSegmentGeom tls;
-    tls.SetLineSegment(a + normalRadius, b + normalRadius);
-    vector<CollisionInfo> ci;
-    ci.reserve(1);
-    if (tls.CollisionRay(from, to, ci))
+bool LineSegmentGeom::SweepCircle(float radius, const vector2 &from, const vector2 &to, float &fraction, vector2 &normal)
+{
+    assert(radius > 0);
+    vector2 d = to - from;
+    float best = 2;
+    if (invLenSq > 0)
     {
-        assert(ci.size() == 1);
-        CollisionInfo &cr = ci[0];
-        if ((tmpcollide - from).len() < (cr.pos - from).len())
+        // the side facing the circle, reached when the center is 'radius' away from the line
+        vector2 n = this->normal;
+        float s = dot_product(from - a, n);
+        if (s < 0)
         {
-            collideinfo.push_back(cr);
-            flag = true;
+            n = -n;
+            s = -s;
         }
-        ci.clear();
-    }
-    tls.SetLineSegment(a - normalRadius, b - normalRadius);
-    if (tls.CollisionRay(from, to, ci))
-    {
-        assert(ci.size() == 1);
-        CollisionInfo &cr = ci[0];
-        if ((tmpcollide - from).len() < (cr.pos - from).len())
+        float ds = dot_product(d, n);
+        if (ds < 0 && s - radius <= -ds)
         {
-            collideinfo.push_back(cr);
-            flag = true;
+            float t = max(0.0f, (s - radius) / -ds);
+            float f = dot_product(from + d * t - a, ab) * invLenSq;
+            if (f >= 0 && f <= 1)
+            {
+                best = t;
+                normal = n;
+            }
         }
-        ci.clear();
     }
-
-    vector2 tangentRadius = b - a;
-    tangentRadius.norm();
-    tangentRadius *= radius;
-
-    ArcGeom ta;
-    ta.SetArc(a, a - tangentRadius, Pi * 0.5f);
-    if (ta.CollisionRay(from, to, ci))
+    // the end points
+    float t;
+    vector2 endNormal;
+    if (SweepPoint(a, radius, from, d, t, endNormal) && t < best)
     {
-        assert(ci.size() == 1);
-        CollisionInfo &cr = ci[0];
-        if ((tmpcollide - from).len() < (cr.pos - from).len())
-        {
-            collideinfo.push_back(cr);
-            flag = true;
-        }
-        ci.clear();
+        best = t;
+        normal = endNormal;
     }
-    ta.SetArc(b, b + tangentRadius, Pi * 0.5f);
-    if (ta.CollisionRay(from, to, ci))
+    if (SweepPoint(b, radius, from, d, t, endNormal) && t < best)
     {
-        assert(ci.size() == 1);
-        CollisionInfo &cr = ci[0];
-        if ((tmpcollide - from).len() < (cr.pos - from).len())
-        {
-            collideinfo.push_back(cr);
-            flag = true;
-        }
-        ci.clear();
+        best = t;
+        normal = endNormal;
     }
-    //if (flag)
-    //    collisionDepth = 0;
-    return flag;
+    if (best > 1)
+        return false;
+    fraction = best;
+    return true;
 }
 
 float ArcGeom::GetDistance(const vector2 &point, vector2 &shadow) const
 {
-    vector2 off1(arc - center);
-    vector2 off2(off1);
-    off1.rotate(radian);
-    off2.rotate(-radian);
-    float len;
-    
-    shadow = off1 + center;
-    len = (point - shadow).len();
-
-    vector2 tmp = off2 + center;
-    float len2 = (point - tmp).len();
-    if (len2 < len)
+    return sqrt(GetDistanceSquared(point, shadow));
+}
+float ArcGeom::GetDistanceSquared(const vector2 &point, vector2 &shadow) const
+{
+    vector2 d1(point - end1), d2(point - end2);
+    float best = dot_product(d1, d1);
+    shadow = end1;
+    float len2 = dot_product(d2, d2);
+    if (len2 < best)
     {
-        shadow = tmp;
-        len = len2;
+        shadow = end2;
+        best = len2;
     }
 
-    vector2 off(arc - center);
-    off.norm();
     vector2 d(point - center);
-    d.norm();
-    if (dot_product(d, off) > cos(radian))
+    float lenSq = dot_product(d, d);
+    float along = dot_product(d, axis);
+    // along / |d| > cosRadian, squared to leave the root out
+    float limit = cosRadian * cosRadian * lenSq;
+    bool onArc = cosRadian >= 0 ? along > 0 && along * along > limit : along >= 0 || along * along < limit;
+    if (onArc && lenSq > 0)
     {
-        len2 = abs((point - center).len() - off1.len());
-        if (len2 < len)
+        float len = sqrt(lenSq);
+        float ring = len - endRadius;
+        if (ring * ring < best)
         {
-            shadow = center + d * off1.len();
-            len = len2;
+            shadow = center + d * (endRadius / len);
+            best = ring * ring;
         }
     }
-    return len;
+    return best;
 }
-bool ArcGeom::CollisionRay(const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+bool ArcGeom::CollisionRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo)
 {
     // boundingbox test
     bbox2 b;
@@ -204,19 +212,20 @@ bool ArcGeom::CollisionRay(const vector2 &from, const vector2 &to, vector<Collis
     {
         vector2 a(from - center);
         vector2 b(to - from);
-        vector2 ta(arc - center);
         float alenS = a.x * a.x + a.y * a.y;
         float blenS = b.x * b.x + b.y * b.y;
         float adotb2 = 2 * dot_product(a, b);
-        float c = alenS - ta.x * ta.x - ta.y * ta.y;
-        float delta = sqrt(adotb2 * adotb2 - 4 * blenS * c);
+        float c = alenS - radiusSq;
+        float discriminant = adotb2 * adotb2 - 4 * blenS * c;
+        if (!(discriminant >= 0))
+            return false; // the line misses the circle
+        float delta = sqrt(discriminant);
         float k1 = (- adotb2 + delta) / (2 * blenS);
         float k2 = (- adotb2 - delta) / (2 * blenS);
         if (k1 > k2)
             swap(k1, k2);
 
-        ta.norm();
-        float cosRadian = cos(radian);
+        const vector2 &ta = axis;
         if (k1 >= 0 && k1 <= 1)
         {
             a.lerp(from, to, k1);
@@ -228,11 +237,12 @@ bool ArcGeom::CollisionRay(const vector2 &from, const vector2 &to, vector<Collis
                 ci.pos = a;
                 ci.normal = t;
                 ci.normal.norm();
-                collideinfo.push_back(ci);
+                ci.geom = this;
+                collideinfo.AddContact(ci);
                 return true;
             }
         }
-        if (k2 >= 0 && k1 <= 1)
+        if (k2 >= 0 && k2 <= 1)
         {
             b.lerp(from, to, k2);
             vector2 t(b - center);
@@ -243,7 +253,8 @@ bool ArcGeom::CollisionRay(const vector2 &from, const vector2 &to, vector<Collis
                 ci.pos = b;
                 ci.normal = t;
                 ci.normal.norm();
-                collideinfo.push_back(ci);
+                ci.geom = this;
+                collideinfo.AddContact(ci);
                 return true;
             }
         }
@@ -251,121 +262,333 @@ bool ArcGeom::CollisionRay(const vector2 &from, const vector2 &to, vector<Collis
     return false;
 }
 
-bool ArcGeom::CollisionCircle(float radius, const vector2 &from, const vector2 &to, vector<CollisionInfo> &collideinfo)
+bool ArcGeom::CollisionCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo)
 {
     assert(radius > 0);
     vector2 shadow;
-    if (GetDistance(from, shadow) <= radius + 0.005f && (to - shadow).len() < (from - shadow).len())
+    float limit = radius + CircleContactTolerance;
+    if (GetDistanceSquared(from, shadow) > limit * limit)
+        return false;
+    // only when moving closer
+    vector2 toShadow = to - shadow, fromShadow = from - shadow;
+    if (dot_product(toShadow, toShadow) < dot_product(fromShadow, fromShadow))
     {
         CollisionInfo ci;
         ci.normal = from - shadow;
         ci.depth = max(0.0f, radius - ci.normal.len());
         ci.normal.norm();
         ci.pos = shadow + ci.normal * (radius + 0.0025f);
-        collideinfo.push_back(ci);
+        ci.geom = this;
+        ci.feature = shadow == end1 ? CollisionInfo::FirstEnd : shadow == end2 ? CollisionInfo::SecondEnd : CollisionInfo::Face;
+        collideinfo.AddContact(ci);
         return true;
     }
     return false;
+}
 
-    bool flag = false;
-    vector2 tmpcollide;
-
-    ArcGeom ta;
-    vector2 ca = arc - center;
-    vector2 normalRadius = ca;
-    normalRadius.norm();
-    normalRadius *= radius;
-
-    vector<CollisionInfo> ci;
-    ta.SetArc(center, arc + normalRadius, radian);
-    if (ta.CollisionRay(from, to, ci))
+bool ArcGeom::SweepCircle(float radius, const vector2 &from, const vector2 &to, float &fraction, vector2 &normal)
+{
+    assert(radius > 0);
+    vector2 d = to - from;
+    vector2 m = from - center;
+    float a = dot_product(d, d);
+    float b = dot_product(m, d);
+    float distSq = dot_product(m, m);
+    float best = 2;
+    if (a > 0)
     {
-        assert(ci.size() == 1);
-        CollisionInfo &cr = ci[0];
-        if ((tmpcollide - from).len() < (cr.pos - from).len())
+        // outer side, the center comes down to endRadius + radius
+        if (b < 0 && distSq >= radiusSq)
         {
-            collideinfo.push_back(cr);
-            flag = true;
+            float outer = endRadius + radius;
+            float c = distSq - outer * outer;
+            float t = -1;
+            if (c <= 0)
+                t = 0;
+            else if (b * b - a * c >= 0)
+                t = (-b - sqrt(b * b - a * c)) / a;
+            if (t >= 0 && t <= 1)
+            {
+                vector2 u = m + d * t;
+                u.norm();
+                if (dot_product(u, axis) >= cosRadian)
+                {
+                    best = t;
+                    normal = u;
+                }
+            }
         }
-        ci.clear();
-    }
-    if (radius < (arc - center).len())
-    {
-        ta.SetArc(center, arc - normalRadius, radian);
-        if (ta.CollisionRay(from, to, ci))
+        // inner side, the center goes out through endRadius - radius. The path may
+        // also come in from outside through the open part of the circle
+        float inner = endRadius - radius;
+        if (inner > 0)
         {
-            assert(ci.size() == 1);
-            CollisionInfo &cr = ci[0];
-            if ((tmpcollide - from).len() < (cr.pos - from).len())
+            float c = distSq - inner * inner;
+            float t = -1;
+            if (c >= 0 && distSq < radiusSq && b > 0)
+                t = 0;
+            else if (b * b - a * c >= 0)
+                t = (-b + sqrt(b * b - a * c)) / a;
+            if (t >= 0 && t <= 1 && t < best)
             {
-                collideinfo.push_back(cr);
-                flag = true;
+                vector2 u = m + d * t;
+                u.norm();
+                if (dot_product(u, axis) >= cosRadian)
+                {
+                    best = t;
+                    normal = -u;
+                }
             }
-            ci.clear();
         }
     }
+    float t;
+    vector2 endNormal;
+    if (SweepPoint(end1, radius, from, d, t, endNormal) && t < best)
+    {
+        best = t;
+        normal = endNormal;
+    }
+    if (SweepPoint(end2, radius, from, d, t, endNormal) && t < best)
+    {
+        best = t;
+        normal = endNormal;
+    }
+    if (best > 1)
+        return false;
+    fraction = best;
+    return true;
+}
 
-    vector2 nr1 = ca, nr2 = ca;
-    nr1.rotate(radian);
-    nr2.rotate(-radian);
-    vector2 c1 = center + nr1, c2 = center + nr2;
-    nr1.rotate(Pi / 2);
-    nr2.rotate(-Pi / 2);
-    nr1.norm();
-    nr2.norm();
-    vector2 ca1 = nr1 * radius;
-    vector2 ca2 = nr2 * radius;
-    ta.SetArc(c1, c1 + ca1, Pi * 0.5f);
-    if (ta.CollisionRay(from, to, ci))
+void ContactBuffer::Begin(const CircleQueryBatch &batch)
+{
+    this->batch = batch;
+    SetBounds(batch.count, CircleContactTolerance);
+}
+
+void ContactBuffer::Begin(const RayQueryBatch &batch)
+{
+    this->batch = CircleQueryBatch();
+    static_cast<RayQueryBatch &>(this->batch) = batch;
+    SetBounds(batch.count, 0);
+}
+
+void ContactBuffer::SetBounds(size_t count, float margin)
+{
+    minX.resize(count);
+    minY.resize(count);
+    maxX.resize(count);
+    maxY.resize(count);
+    for (size_t i = 0; i < count; i++)
     {
-        assert(ci.size() == 1);
-        CollisionInfo &cr = ci[0];
-        if ((tmpcollide - from).len() < (cr.pos - from).len())
-        {
-            collideinfo.push_back(cr);
-            flag = true;
-        }
-        ci.clear();
+        float r = batch.radius ? batch.radius[i] + margin : margin;
+        bbox2 box = SweepBox(batch.GetFrom(i), batch.GetTo(i), r);
+        minX[i] = box.vmin.x;
+        minY[i] = box.vmin.y;
+        maxX[i] = box.vmax.x;
+        maxY[i] = box.vmax.y;
     }
+    lastCollision.assign(count, GeomPtr(0));
+    pending.clear();
+    pendingQuery.clear();
+}
 
-    ta.SetArc(c2, c2 + ca2, Pi * 0.5f);
-    if (ta.CollisionRay(from, to, ci))
+void ContactBuffer::AddCircle(GeomPtr geom, size_t query)
+{
+    assert(query < batch.count && batch.radius);
+    ContactVector sink(pending);
+    if (context.stats.CollisionCircle(geom, batch.radius[query], batch.GetFrom(query), batch.GetTo(query), sink))
     {
-        assert(ci.size() == 1);
-        CollisionInfo &cr = ci[0];
-        if ((tmpcollide - from).len() < (cr.pos - from).len())
-        {
-            collideinfo.push_back(cr);
-            flag = true;
-        }
-        ci.clear();
+        pendingQuery.resize(pending.size(), query);
+        lastCollision[query] = geom;
+    }
+}
+
+void ContactBuffer::AddCircleQuery(const Space &space, size_t query)
+{
+    assert(query < batch.count && batch.radius);
+    ContactVector sink(pending);
+    if (space.QueryCircle(batch.radius[query], batch.GetFrom(query), batch.GetTo(query), sink, lastCollision[query], context))
+        pendingQuery.resize(pending.size(), query);
+}
+
+void ContactBuffer::AddRayQuery(const Space &space, size_t query)
+{
+    assert(query < batch.count);
+    ContactVector sink(pending);
+    if (space.QueryRay(batch.GetFrom(query), batch.GetTo(query), sink, lastCollision[query], context))
+        pendingQuery.resize(pending.size(), query);
+}
+
+void ContactBuffer::End()
+{
+    // counting sort by query, stable so every query keeps its own contact order
+    size_t n = batch.count;
+    offsets.assign(n + 1, 0);
+    for (vector<size_t>::const_iterator q = pendingQuery.begin(); q != pendingQuery.end(); ++q)
+        offsets[*q + 1]++;
+    for (size_t i = 0; i < n; i++)
+        offsets[i + 1] += offsets[i];
+    contacts.resize(pending.size());
+    cursor.assign(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < pending.size(); i++)
+        contacts[cursor[pendingQuery[i]]++] = pending[i];
+}
+
+void ContactBuffer::CountQueries()
+{
+    if (!QueryStats::IsEnabled())
+        return;
+    for (size_t i = 0; i < batch.count; i++)
+        context.stats.AddQuery((unsigned int)GetCount(i));
+}
+
+void ContactBuffer::Assign(const ContactBuffer *parts, size_t numParts)
+{
+    contacts.clear();
+    offsets.assign(1, 0);
+    lastCollision.clear();
+    for (size_t p = 0; p < numParts; p++)
+    {
+        const ContactBuffer &part = parts[p];
+        size_t base = contacts.size();
+        contacts.insert(contacts.end(), part.contacts.begin(), part.contacts.end());
+        for (size_t i = 1; i < part.offsets.size(); i++)
+            offsets.push_back(base + part.offsets[i]);
+        lastCollision.insert(lastCollision.end(), part.lastCollision.begin(), part.lastCollision.end());
     }
-/*
-    if (flag && GetDistance(collide, shadow) <= radius + 0.005f)
+}
+
+ClosestRayHit::ClosestRayHit(const vector2 &from, const vector2 &to, QueryStats &stats) :
+    from(from), to(to), dir(to - from), improved(false), numContacts(0), stats(stats)
+{
+    float lenSq = dir.x * dir.x + dir.y * dir.y;
+    invLenSq = lenSq > 0 ? 1.0f / lenSq : 0.0f;
+}
+
+bool ClosestRayHit::Test(GeomPtr geom)
+{
+    vector2 end = GetEnd();
+    if (!stats.CountBox(BoxOverlap(geom->GetBBox(), SweepBox(from, end, 0))))
+        return false;
+    improved = false;
+    size_t before = numContacts;
+    stats.CountNarrow(geom);
+    geom->CollisionRay(from, end, *this);
+    stats.CountContacts(geom, numContacts - before);
+    if (improved)
+        hit.geom = geom;
+    return improved;
+}
+
+void ClosestRayHit::AddContact(const CollisionInfo &ci)
+{
+    numContacts++;
+    float fraction = dot_product(ci.pos - from, dir) * invLenSq;
+    if ((!Found() && !improved) || fraction < hit.fraction)
     {
-        CollisionInfo ci;
-        ci.normal = from - shadow;
-        ci.depth = max(0.0f, radius - ci.normal.len());
-        ci.normal.norm();
-        ci.pos = shadow + ci.normal * (radius + 0.0025f);
-        collideinfo.push_back(ci);
-        return true;
+        hit.info = ci;
+        hit.fraction = fraction;
+        improved = true;
     }
-    */
-    if (!flag && GetDistance(to, shadow) <= radius + 0.005f)
+}
+
+bool Space::QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    ClosestRayHit closest(from, to, context.stats);
+    for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
+        closest.Test(*g);
+    if (!closest.Found())
+        return false;
+    hit = closest.GetHit();
+    return true;
+}
+
+ClosestSweepHit::ClosestSweepHit(float radius, const vector2 &from, const vector2 &to, QueryStats &stats) :
+    radius(radius), from(from), to(to), stats(stats)
+{
+}
+
+bool ClosestSweepHit::Test(GeomPtr geom)
+{
+    if (!stats.CountBox(BoxOverlap(geom->GetBBox(), GetBound())))
+        return false;
+    float fraction;
+    vector2 normal;
+    stats.CountNarrow(geom);
+    if (!geom->SweepCircle(radius, from, to, fraction, normal))
+        return false;
+    stats.CountContacts(geom, 1);
+    if (Found() && !(fraction < hit.fraction))
+        return false;
+    hit.fraction = fraction;
+    hit.info.normal = normal;
+    hit.info.pos = from + (to - from) * fraction;
+    hit.geom = geom;
+    return true;
+}
+
+bool Space::QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    ClosestSweepHit closest(radius, from, to, context.stats);
+    for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
+        closest.Test(*g);
+    if (!closest.Found())
+        return false;
+    hit = closest.GetHit();
+    return true;
+}
+
+void Space::CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const
+{
+    out.Begin(batch);
+    out.hitMask.resize(batch.count);
+    const float *minX = batch.count ? &out.minX[0] : 0;
+    const float *minY = batch.count ? &out.minY[0] : 0;
+    const float *maxX = batch.count ? &out.maxX[0] : 0;
+    const float *maxY = batch.count ? &out.maxY[0] : 0;
+    unsigned char *hit = batch.count ? &out.hitMask[0] : 0;
+    // walk the geoms once, every geom is tested against all queries while it is in cache
+    for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
     {
-        CollisionInfo ci;
-        ci.normal = from - shadow;
-        ci.depth = max(0.0f, radius - ci.normal.len());
-        ci.normal.norm();
-        ci.pos = shadow + ci.normal * (radius + 0.0025f);
-        collideinfo.push_back(ci);
-        return true;
+        const bbox2 &box = (*g)->GetBBox();
+        size_t numHits = 0;
+        // branch free box test over the SoA bounds
+        for (size_t i = 0; i < batch.count; i++)
+        {
+            hit[i] = (unsigned char)((box.vmax.x >= minX[i]) & (box.vmin.x <= maxX[i]) &
+                                     (box.vmax.y >= minY[i]) & (box.vmin.y <= maxY[i]));
+            numHits += hit[i];
+        }
+        out.context.stats.CountBoxes((unsigned int)batch.count, (unsigned int)numHits);
+        for (size_t i = 0; numHits > 0 && i < batch.count; i++)
+        {
+            if (hit[i])
+            {
+                out.AddCircle(*g, i);
+                numHits--;
+            }
+        }
     }
-    //if (flag)
-    //    collisionDepth = 0;
+    out.End();
+    out.CountQueries();
+}
 
-    return flag;
+void Space::CollisionCircleBatchPerQuery(const CircleQueryBatch &batch, ContactBuffer &out) const
+{
+    out.Begin(batch);
+    for (size_t i = 0; i < batch.count; i++)
+        out.AddCircleQuery(*this, i);
+    out.End();
+}
+
+void Space::CollisionRayBatch(const RayQueryBatch &batch, ContactBuffer &out) const
+{
+    out.Begin(batch);
+    for (size_t i = 0; i < batch.count; i++)
+        out.AddRayQuery(*this, i);
+    out.End();
 }
 
 }
@@ -0,0 +1,110 @@
+#include <cassert>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "profiler.h"
+
+namespace
+{
+    /// seconds from some fixed point in the past
+    double GetSeconds()
+    {
+#ifdef _WIN32
+        LARGE_INTEGER count, frequency;
+        QueryPerformanceCounter(&count);
+        QueryPerformanceFrequency(&frequency);
+        return double(count.QuadPart) / double(frequency.QuadPart);
+#else
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+    }
+}
+
+Profiler &Profiler::Instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() : start(GetSeconds()), frames(MaxFrames + 1), current(0), finished(0), depth(0)
+{
+}
+
+double Profiler::GetTime() const
+{
+    return (GetSeconds() - start) * 1e6;
+}
+
+int Profiler::Enter(const char *name)
+{
+    vector<Zone> &zones = frames[current];
+    int index = int(zones.size());
+    depth++;
+    if (index >= MaxZonesPerFrame)
+        return -1;
+    Zone zone;
+    zone.name = name;
+    zone.depth = depth - 1;
+    zone.begin = GetTime();
+    zone.end = zone.begin;
+    zones.push_back(zone);
+    return index;
+}
+
+void Profiler::Leave(int zone)
+{
+    assert(depth > 0);
+    depth--;
+    if (zone >= 0)
+        frames[current][zone].end = GetTime();
+}
+
+void Profiler::NextFrame()
+{
+    // zones must not span frames
+    assert(depth == 0);
+    current = (current + 1) % (MaxFrames + 1);
+    frames[current].clear();
+    if (finished < MaxFrames)
+        finished++;
+}
+
+int Profiler::GetFrameCount() const
+{
+    return finished;
+}
+
+const vector<Profiler::Zone> &Profiler::GetFrame(int age) const
+{
+    assert(age >= 0 && age < finished);
+    return frames[(current + MaxFrames - age) % (MaxFrames + 1)];
+}
+
+bool Profiler::WriteChromeTrace(const char *path) const
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "{\"traceEvents\": [\n");
+    bool first = true;
+    for (int age = finished - 1; age >= 0; age--)
+    {
+        const vector<Zone> &zones = GetFrame(age);
+        for (vector<Zone>::const_iterator z = zones.begin(); z != zones.end(); ++z)
+        {
+            // complete events, the viewer nests them by time
+            fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": 1}",
+                first ? "" : ",\n", z->name, z->begin, z->end - z->begin);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,327 @@
+#include <cassert>
+#include "quadTreeSpace.h"
+
+namespace Phy2d
+{
+static bbox2 GetQuadrant(const bbox2 &area, QuadTreeSpace::SubSpaceIndex index)
+{
+    vector2 ext = area.extents() * 0.5f;
+    vector2 center = area.center();
+    switch(index)
+    {
+    case QuadTreeSpace::LeftTop:
+        return bbox2(center + vector2(-ext.x, ext.y), ext);
+    case QuadTreeSpace::RightTop:
+        return bbox2(center + vector2(ext.x, ext.y), ext);
+    case QuadTreeSpace::LeftBottom:
+        return bbox2(center + vector2(-ext.x, -ext.y), ext);
+    case QuadTreeSpace::RightBottom:
+    default:
+        return bbox2(center + vector2(ext.x, -ext.y), ext);
+    }
+}
+
+QuadTreeSpace::QuadTreeSpace(const bbox2 &area, int maxDepth, float looseness) :
+    looseness(looseness), depth(0), maxDepth(maxDepth), count(0), parent(0), numReinserted(0)
+{
+    assert(looseness >= 1.0f);
+    for (int i = 0; i < NumSubSpaces; i++)
+        child[i] = 0;
+    SetArea(area);
+}
+
+QuadTreeSpace::QuadTreeSpace(QuadTreeSpace *parent, SubSpaceIndex index) :
+    looseness(parent->looseness), depth(parent->depth + 1), maxDepth(parent->maxDepth), count(0), parent(parent),
+    numReinserted(0)
+{
+    for (int i = 0; i < NumSubSpaces; i++)
+        child[i] = 0;
+    topSpace = parent->topSpace;
+    SetArea(GetQuadrant(parent->area, index));
+}
+
+QuadTreeSpace::~QuadTreeSpace()
+{
+    for (int i = 0; i < NumSubSpaces; i++)
+        delete child[i];
+}
+
+void QuadTreeSpace::SetArea(const bbox2 &area)
+{
+    this->area = area;
+    looseArea.set(area.center(), area.extents() * looseness);
+}
+
+QuadTreeSpace::SubSpaceIndex QuadTreeSpace::GetSubSpaceIndex(const vector2 &p) const
+{
+    vector2 splitCenter = area.center();
+    if (p.x < splitCenter.x)
+        return p.y > splitCenter.y ? LeftTop : LeftBottom;
+    return p.y > splitCenter.y ? RightTop : RightBottom;
+}
+
+void QuadTreeSpace::Insert(GeomPtr geom)
+{
+    const bbox2 &box = geom->GetBBox();
+    vector2 boxCenter = box.center();
+    QuadTreeSpace *node = this;
+    node->count++;
+    while (node->depth < node->maxDepth)
+    {
+        SubSpaceIndex index = node->GetSubSpaceIndex(boxCenter);
+        if (!node->child[index])
+        {
+            bbox2 quadrant = GetQuadrant(node->area, index);
+            bbox2 loose(quadrant.center(), quadrant.extents() * looseness);
+            if (!BoxContains(loose, box))
+                break;
+            node->child[index] = new QuadTreeSpace(node, index);
+        }
+        else if (!BoxContains(node->child[index]->looseArea, box))
+            break;
+        node = node->child[index];
+        node->count++;
+    }
+    geom->SetSpace(node, int(node->geoms.size()));
+    node->geoms.push_back(geom);
+}
+
+void QuadTreeSpace::Remove(size_t index)
+{
+    assert(index < geoms.size());
+    geoms[index]->SetSpace(0, -1);
+    geoms[index] = geoms.back();
+    geoms.pop_back();
+    if (index < geoms.size())
+        geoms[index]->SetSpace(this, int(index));
+    for (QuadTreeSpace *node = this; node; node = node->parent)
+    {
+        assert(node->count > 0);
+        node->count--;
+    }
+}
+
+void QuadTreeSpace::OnGeomMoved(GeomPtr geom)
+{
+    QuadTreeSpace *root = this;
+    while (root->parent)
+        root = root->parent;
+    root->moved.push_back(geom);
+}
+
+bool QuadTreeSpace::Update()
+{
+    assert(!parent);
+    for (vector<GeomPtr>::iterator g = newgeoms.begin(); g != newgeoms.end(); ++g)
+    {
+        (*g)->GetDirty(); // placed at its current position, nothing left to do
+        Insert(*g);
+    }
+    newgeoms.clear();
+
+    numReinserted = 0;
+    for (vector<GeomPtr>::iterator g = moved.begin(); g != moved.end(); ++g)
+    {
+        GeomPtr geom = *g;
+        if (!geom->GetDirty()) // listed before, already handled
+            continue;
+        QuadTreeSpace *node = static_cast<QuadTreeSpace *>(geom->GetSpace());
+        // the root holds what fits nowhere else, a geom there may fit a child now
+        if (node->parent && BoxContains(node->looseArea, geom->GetBBox()))
+            continue;
+        node->Remove(size_t(geom->GetSpaceProxy()));
+        Insert(geom);
+        numReinserted++;
+    }
+    moved.clear();
+    return false;
+}
+
+bool QuadTreeSpace::QueryRay(const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    return QueryRayNode(SweepBox(from, to, 0), from, to, collideinfo, hit, context.stats);
+}
+
+bool QuadTreeSpace::QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    return QueryCircleNode(SweepBox(from, to, radius + CircleContactTolerance), radius, from, to, collideinfo, hit, context.stats);
+}
+
+bool QuadTreeSpace::QueryRayNode(const bbox2 &bound, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryStats &stats) const
+{
+    // the root also holds geoms outside its area, so it is never culled
+    if (count == 0 || (parent && !BoxOverlap(looseArea, bound)))
+        return false;
+    bool found = false;
+    for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
+    {
+        if (stats.CountBox(BoxOverlap((*g)->GetBBox(), bound)) && stats.CollisionRay(*g, from, to, collideinfo))
+        {
+            hit = *g;
+            found = true;
+        }
+    }
+    for (int i = 0; i < NumSubSpaces; i++)
+    {
+        if (child[i] && child[i]->QueryRayNode(bound, from, to, collideinfo, hit, stats))
+            found = true;
+    }
+    return found;
+}
+
+bool QuadTreeSpace::QueryRayClosest(const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    ClosestRayHit closest(from, to, context.stats);
+    QueryRayClosestNode(closest);
+    if (!closest.Found())
+        return false;
+    hit = closest.GetHit();
+    return true;
+}
+
+void QuadTreeSpace::QueryRayClosestNode(ClosestRayHit &closest) const
+{
+    // the bound shrinks with every hit, so whole nodes behind it are skipped
+    if (count == 0 || (parent && !BoxOverlap(looseArea, closest.GetBound())))
+        return;
+    for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
+        closest.Test(*g);
+    for (int i = 0; i < NumSubSpaces; i++)
+    {
+        if (child[i])
+            child[i]->QueryRayClosestNode(closest);
+    }
+}
+
+bool QuadTreeSpace::QuerySweepCircle(float radius, const vector2 &from, const vector2 &to, RayHit &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    ClosestSweepHit closest(radius, from, to, context.stats);
+    QuerySweepCircleNode(closest);
+    if (!closest.Found())
+        return false;
+    hit = closest.GetHit();
+    return true;
+}
+
+void QuadTreeSpace::QuerySweepCircleNode(ClosestSweepHit &closest) const
+{
+    if (count == 0 || (parent && !BoxOverlap(looseArea, closest.GetBound())))
+        return;
+    for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
+        closest.Test(*g);
+    for (int i = 0; i < NumSubSpaces; i++)
+    {
+        if (child[i])
+            child[i]->QuerySweepCircleNode(closest);
+    }
+}
+
+bool QuadTreeSpace::QueryCircleNode(const bbox2 &bound, float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryStats &stats) const
+{
+    if (count == 0 || (parent && !BoxOverlap(looseArea, bound)))
+        return false;
+    bool found = false;
+    for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
+    {
+        if (stats.CountBox(BoxOverlap((*g)->GetBBox(), bound)) && stats.CollisionCircle(*g, radius, from, to, collideinfo))
+        {
+            hit = *g;
+            found = true;
+        }
+    }
+    for (int i = 0; i < NumSubSpaces; i++)
+    {
+        if (child[i] && child[i]->QueryCircleNode(bound, radius, from, to, collideinfo, hit, stats))
+            found = true;
+    }
+    return found;
+}
+
+void QuadTreeSpace::CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const
+{
+    out.Begin(batch);
+    out.active.clear();
+    for (size_t i = 0; i < batch.count; i++)
+        out.active.push_back(i);
+    QueryCircleBatchNode(0, batch.count, out);
+    out.End();
+    out.CountQueries();
+}
+
+void QuadTreeSpace::QueryCircleBatchNode(size_t begin, size_t end, ContactBuffer &out) const
+{
+    if (count == 0)
+        return;
+    if (parent)
+    {
+        // keep the queries reaching this node on top of the active stack
+        size_t top = out.active.size();
+        for (size_t i = begin; i < end; i++)
+        {
+            size_t q = out.active[i];
+            if (out.Overlap(q, looseArea))
+                out.active.push_back(q);
+        }
+        begin = top;
+        end = out.active.size();
+        if (begin == end)
+            return;
+    }
+    for (vector<GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
+    {
+        const bbox2 &box = (*g)->GetBBox();
+        for (size_t i = begin; i < end; i++)
+        {
+            size_t q = out.active[i];
+            if (out.context.stats.CountBox(out.Overlap(q, box)))
+                out.AddCircle(*g, q);
+        }
+    }
+    for (int i = 0; i < NumSubSpaces; i++)
+    {
+        if (child[i])
+            child[i]->QueryCircleBatchNode(begin, end, out);
+    }
+    if (parent)
+        out.active.resize(begin);
+}
+
+void QuadTreeSpace::CollectGeoms(vector<GeomPtr> &out) const
+{
+    Space::CollectGeoms(out);
+    for (int i = 0; i < NumSubSpaces; i++)
+    {
+        if (child[i])
+            child[i]->CollectGeoms(out);
+    }
+}
+
+void QuadTreeSpace::Reset(const bbox2 &area, int maxDepth)
+{
+    assert(!parent);
+    Clear();
+    this->maxDepth = maxDepth;
+    SetArea(area);
+}
+
+void QuadTreeSpace::Clear()
+{
+    for (vector<GeomPtr>::iterator g = geoms.begin(); g != geoms.end(); ++g)
+        (*g)->SetSpace(0, -1);
+    Space::Clear();
+    for (int i = 0; i < NumSubSpaces; i++)
+    {
+        if (child[i])
+            child[i]->Clear();
+        delete child[i];
+        child[i] = 0;
+    }
+    count = 0;
+    moved.clear();
+}
+
+}
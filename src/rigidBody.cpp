@@ -0,0 +1,84 @@
+#include <cassert>
+#include "rigidBody.h"
+
+namespace Phy2d
+{
+    RigidBody::RigidBody()
+    {
+        bounds.begin_extend();
+        bounds.end_extend();
+    }
+
+    RigidBody::~RigidBody()
+    {
+        for (vector<GeomPtr>::iterator g = geoms.begin(); g != geoms.end(); ++g)
+            (*g)->body = 0;
+    }
+
+    void RigidBody::AddGeom(GeomPtr geom)
+    {
+        assert(geom && !geom->body);
+        geom->body = this;
+        geom->toParent = -pos;
+        geom->toWorld.set(0, 0);
+        if (geoms.empty())
+            bounds = geom->GetBBox();
+        else
+            bounds.extend(geom->GetBBox());
+        geoms.push_back(geom);
+    }
+
+    void RigidBody::SetPosition(const vector2 &pos)
+    {
+        this->pos = pos;
+        Place();
+    }
+
+    bool RigidBody::Step(float delta)
+    {
+        if (vel.x == 0 && vel.y == 0)
+            return false;
+        pos += vel * delta;
+        Place();
+        return true;
+    }
+
+    bool RigidBody::MoveTo(const vector2 &pos, float delta)
+    {
+        assert(delta > 0);
+        vel = (pos - this->pos) * (1.0f / delta);
+        if (pos.x == this->pos.x && pos.y == this->pos.y)
+            return false;
+        this->pos = pos;
+        Place();
+        return true;
+    }
+
+    void RigidBody::Place()
+    {
+        for (vector<GeomPtr>::iterator g = geoms.begin(); g != geoms.end(); ++g)
+        {
+            Geom &geom = **g;
+            vector2 toWorld = pos + geom.toParent;
+            geom.Translate(toWorld - geom.toWorld);
+            geom.toWorld = toWorld;
+            if (g == geoms.begin())
+                bounds = geom.GetBBox();
+            else
+                bounds.extend(geom.GetBBox());
+        }
+    }
+
+    vector2 SupportVelocity(const CollisionInfo *contacts, size_t count)
+    {
+        const CollisionInfo *support = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!support || contacts[i].force > support->force)
+                support = &contacts[i];
+        }
+        if (!support || !support->geom || !support->geom->GetBody())
+            return vector2(0, 0);
+        return support->geom->GetBody()->GetVelocity();
+    }
+}
@@ -0,0 +1,355 @@
+#include <cassert>
+#include <cmath>
+#include "segmentSpace.h"
+
+#if !defined(PHY2D_NO_SIMD) && defined(__AVX__)
+#define PHY2D_AVX
+#include <immintrin.h>
+#elif !defined(PHY2D_NO_SIMD) && (defined(__SSE__) || defined(_M_IX86) || defined(_M_X64))
+#define PHY2D_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace Phy2d
+{
+const float PaddingCoord = 1e30f;  // distance to padding overflows to infinity
+const float AngleSlack = 0.001f;   // arcs are widened by this much cosine
+
+/// reach of a near test, grown to cover rounding differences to the exact test
+static float GetNearLimit(float maxDistance)
+{
+    float reach = maxDistance * 1.001f + 0.01f;
+    return reach * reach;
+}
+
+/// append base + i for every bit i set in 'mask'
+static void PushMask(int mask, size_t base, vector<size_t> &out)
+{
+    for (size_t i = 0; mask; i++, mask >>= 1)
+    {
+        if (mask & 1)
+            out.push_back(base + i);
+    }
+}
+
+void SegmentStore::Reserve(size_t n)
+{
+    // keep the arrays a multiple of Width long, the tail is padding
+    size_t padded = (n + Width - 1) / Width * Width;
+    if (padded <= ax.size())
+        return;
+    ax.resize(padded, PaddingCoord);
+    ay.resize(padded, PaddingCoord);
+    abx.resize(padded, 0);
+    aby.resize(padded, 0);
+    invLenSq.resize(padded, 0);
+}
+
+size_t SegmentStore::Add()
+{
+    Reserve(count + 1);
+    return count++;
+}
+
+void SegmentStore::SetSegment(size_t slot, const vector2 &a, const vector2 &b)
+{
+    assert(slot < count);
+    ax[slot] = a.x;
+    ay[slot] = a.y;
+    abx[slot] = b.x - a.x;
+    aby[slot] = b.y - a.y;
+    float lenSq = abx[slot] * abx[slot] + aby[slot] * aby[slot];
+    invLenSq[slot] = lenSq > 0 ? 1.0f / lenSq : 0;
+}
+
+void SegmentStore::Clear()
+{
+    count = 0;
+    ax.clear();
+    ay.clear();
+    abx.clear();
+    aby.clear();
+    invLenSq.clear();
+}
+
+float SegmentStore::GetDistanceSquared(size_t slot, const vector2 &point) const
+{
+    assert(slot < count);
+    float px = point.x - ax[slot];
+    float py = point.y - ay[slot];
+    float t = (px * abx[slot] + py * aby[slot]) * invLenSq[slot];
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    float dx = px - abx[slot] * t;
+    float dy = py - aby[slot] * t;
+    return dx * dx + dy * dy;
+}
+
+void SegmentStore::GatherNear(const vector2 &point, float maxDistance, vector<size_t> &out) const
+{
+    float limit = GetNearLimit(maxDistance);
+#if defined(PHY2D_AVX) || defined(PHY2D_SSE)
+    size_t end = (count + Width - 1) / Width * Width;
+#endif
+#if defined(PHY2D_AVX)
+    const __m256 x = _mm256_set1_ps(point.x), y = _mm256_set1_ps(point.y);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    const __m256 lim = _mm256_set1_ps(limit);
+    for (size_t i = 0; i < end; i += 8)
+    {
+        __m256 abX = _mm256_loadu_ps(&abx[i]), abY = _mm256_loadu_ps(&aby[i]);
+        __m256 px = _mm256_sub_ps(x, _mm256_loadu_ps(&ax[i]));
+        __m256 py = _mm256_sub_ps(y, _mm256_loadu_ps(&ay[i]));
+        __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(px, abX), _mm256_mul_ps(py, abY)), _mm256_loadu_ps(&invLenSq[i]));
+        t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+        __m256 dx = _mm256_sub_ps(px, _mm256_mul_ps(abX, t));
+        __m256 dy = _mm256_sub_ps(py, _mm256_mul_ps(abY, t));
+        __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, lim, _CMP_LE_OQ));
+        PushMask(mask, i, out);
+    }
+#elif defined(PHY2D_SSE)
+    const __m128 x = _mm_set1_ps(point.x), y = _mm_set1_ps(point.y);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 lim = _mm_set1_ps(limit);
+    for (size_t i = 0; i < end; i += 4)
+    {
+        __m128 abX = _mm_loadu_ps(&abx[i]), abY = _mm_loadu_ps(&aby[i]);
+        __m128 px = _mm_sub_ps(x, _mm_loadu_ps(&ax[i]));
+        __m128 py = _mm_sub_ps(y, _mm_loadu_ps(&ay[i]));
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(px, abX), _mm_mul_ps(py, abY)), _mm_loadu_ps(&invLenSq[i]));
+        t = _mm_min_ps(_mm_max_ps(t, zero), one);
+        __m128 dx = _mm_sub_ps(px, _mm_mul_ps(abX, t));
+        __m128 dy = _mm_sub_ps(py, _mm_mul_ps(abY, t));
+        __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        int mask = _mm_movemask_ps(_mm_cmple_ps(d2, lim));
+        PushMask(mask, i, out);
+    }
+#else
+    for (size_t i = 0; i < count; i++)
+    {
+        if (GetDistanceSquared(i, point) <= limit)
+            out.push_back(i);
+    }
+#endif
+}
+
+void ArcStore::Reserve(size_t n)
+{
+    size_t padded = (n + Width - 1) / Width * Width;
+    if (padded <= cx.size())
+        return;
+    cx.resize(padded, PaddingCoord);
+    cy.resize(padded, PaddingCoord);
+    radius.resize(padded, 0);
+    axisX.resize(padded, 0);
+    axisY.resize(padded, 0);
+    cosLimit.resize(padded, 0);
+    e1x.resize(padded, PaddingCoord);
+    e1y.resize(padded, PaddingCoord);
+    e2x.resize(padded, PaddingCoord);
+    e2y.resize(padded, PaddingCoord);
+}
+
+size_t ArcStore::Add()
+{
+    Reserve(count + 1);
+    return count++;
+}
+
+void ArcStore::SetArc(size_t slot, const ArcGeom &arc)
+{
+    assert(slot < count);
+    cx[slot] = arc.center.x;
+    cy[slot] = arc.center.y;
+    radius[slot] = arc.endRadius;
+    axisX[slot] = arc.axis.x;
+    axisY[slot] = arc.axis.y;
+    cosLimit[slot] = arc.cosRadian - AngleSlack;
+    e1x[slot] = arc.end1.x;
+    e1y[slot] = arc.end1.y;
+    e2x[slot] = arc.end2.x;
+    e2y[slot] = arc.end2.y;
+}
+
+void ArcStore::Clear()
+{
+    count = 0;
+    cx.clear();
+    cy.clear();
+    radius.clear();
+    axisX.clear();
+    axisY.clear();
+    cosLimit.clear();
+    e1x.clear();
+    e1y.clear();
+    e2x.clear();
+    e2y.clear();
+}
+
+float ArcStore::GetDistanceSquared(size_t slot, const vector2 &point) const
+{
+    assert(slot < count);
+    // nearest end point
+    float dx = point.x - e1x[slot], dy = point.y - e1y[slot];
+    float best = dx * dx + dy * dy;
+    dx = point.x - e2x[slot];
+    dy = point.y - e2y[slot];
+    best = min(best, dx * dx + dy * dy);
+    // the circle, if the point lies inside the arc's angle
+    float vx = point.x - cx[slot], vy = point.y - cy[slot];
+    float len = sqrt(vx * vx + vy * vy);
+    if (vx * axisX[slot] + vy * axisY[slot] >= cosLimit[slot] * len)
+    {
+        float d = len - radius[slot];
+        best = min(best, d * d);
+    }
+    return best;
+}
+
+void ArcStore::GatherNear(const vector2 &point, float maxDistance, vector<size_t> &out) const
+{
+    float limit = GetNearLimit(maxDistance);
+#if defined(PHY2D_AVX) || defined(PHY2D_SSE)
+    size_t end = (count + Width - 1) / Width * Width;
+#endif
+#if defined(PHY2D_AVX)
+    const __m256 x = _mm256_set1_ps(point.x), y = _mm256_set1_ps(point.y);
+    const __m256 lim = _mm256_set1_ps(limit);
+    for (size_t i = 0; i < end; i += 8)
+    {
+        __m256 dx = _mm256_sub_ps(x, _mm256_loadu_ps(&e1x[i]));
+        __m256 dy = _mm256_sub_ps(y, _mm256_loadu_ps(&e1y[i]));
+        __m256 best = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        dx = _mm256_sub_ps(x, _mm256_loadu_ps(&e2x[i]));
+        dy = _mm256_sub_ps(y, _mm256_loadu_ps(&e2y[i]));
+        best = _mm256_min_ps(best, _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+        __m256 vx = _mm256_sub_ps(x, _mm256_loadu_ps(&cx[i]));
+        __m256 vy = _mm256_sub_ps(y, _mm256_loadu_ps(&cy[i]));
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)));
+        __m256 cosine = _mm256_add_ps(_mm256_mul_ps(vx, _mm256_loadu_ps(&axisX[i])), _mm256_mul_ps(vy, _mm256_loadu_ps(&axisY[i])));
+        __m256 inside = _mm256_cmp_ps(cosine, _mm256_mul_ps(_mm256_loadu_ps(&cosLimit[i]), len), _CMP_GE_OQ);
+        __m256 d = _mm256_sub_ps(len, _mm256_loadu_ps(&radius[i]));
+        __m256 pass = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_mul_ps(d, d), lim, _CMP_LE_OQ));
+        pass = _mm256_or_ps(pass, _mm256_cmp_ps(best, lim, _CMP_LE_OQ));
+        PushMask(_mm256_movemask_ps(pass), i, out);
+    }
+#elif defined(PHY2D_SSE)
+    const __m128 x = _mm_set1_ps(point.x), y = _mm_set1_ps(point.y);
+    const __m128 lim = _mm_set1_ps(limit);
+    for (size_t i = 0; i < end; i += 4)
+    {
+        __m128 dx = _mm_sub_ps(x, _mm_loadu_ps(&e1x[i]));
+        __m128 dy = _mm_sub_ps(y, _mm_loadu_ps(&e1y[i]));
+        __m128 best = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        dx = _mm_sub_ps(x, _mm_loadu_ps(&e2x[i]));
+        dy = _mm_sub_ps(y, _mm_loadu_ps(&e2y[i]));
+        best = _mm_min_ps(best, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+        __m128 vx = _mm_sub_ps(x, _mm_loadu_ps(&cx[i]));
+        __m128 vy = _mm_sub_ps(y, _mm_loadu_ps(&cy[i]));
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+        __m128 cosine = _mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(&axisX[i])), _mm_mul_ps(vy, _mm_loadu_ps(&axisY[i])));
+        __m128 inside = _mm_cmpge_ps(cosine, _mm_mul_ps(_mm_loadu_ps(&cosLimit[i]), len));
+        __m128 d = _mm_sub_ps(len, _mm_loadu_ps(&radius[i]));
+        __m128 pass = _mm_and_ps(inside, _mm_cmple_ps(_mm_mul_ps(d, d), lim));
+        pass = _mm_or_ps(pass, _mm_cmple_ps(best, lim));
+        PushMask(_mm_movemask_ps(pass), i, out);
+    }
+#else
+    for (size_t i = 0; i < count; i++)
+    {
+        if (GetDistanceSquared(i, point) <= limit)
+            out.push_back(i);
+    }
+#endif
+}
+
+void SegmentSpace::Insert(size_t index)
+{
+    switch (geoms[index]->GetType())
+    {
+    case Geom::LineSeg:
+        slots.push_back(segments.Add());
+        segmentGeoms.push_back(index);
+        break;
+    case Geom::Arc:
+        slots.push_back(arcs.Add());
+        arcGeoms.push_back(index);
+        break;
+    default:
+        slots.push_back(otherGeoms.size());
+        otherGeoms.push_back(index);
+        break;
+    }
+    Refresh(index);
+}
+
+void SegmentSpace::Refresh(size_t index)
+{
+    GeomPtr g = geoms[index];
+    if (g->GetType() == Geom::LineSeg)
+        segments.SetSegment(slots[index], g->GetVector2(0), g->GetVector2(1));
+    else if (g->GetType() == Geom::Arc)
+        arcs.SetArc(slots[index], *static_cast<ArcGeom *>(g));
+}
+
+bool SegmentSpace::Update()
+{
+    for (vector<GeomPtr>::iterator g = newgeoms.begin(); g != newgeoms.end(); ++g)
+    {
+        (*g)->GetDirty();
+        geoms.push_back(*g);
+        Insert(geoms.size() - 1);
+    }
+    newgeoms.clear();
+    for (size_t i = 0; i < geoms.size(); i++)
+    {
+        if (geoms[i]->GetDirty())
+            Refresh(i);
+    }
+    return false;
+}
+
+void SegmentSpace::Clear()
+{
+    Space::Clear();
+    segments.Clear();
+    arcs.Clear();
+    segmentGeoms.clear();
+    arcGeoms.clear();
+    otherGeoms.clear();
+    slots.clear();
+}
+
+bool SegmentSpace::QueryCircle(float radius, const vector2 &from, const vector2 &to, ContactSink &collideinfo, GeomPtr &hit, QueryContext &context) const
+{
+    QueryStats::Scope count(context.stats);
+    // gather slots of both stores, turn them into geom indices and restore the geom order
+    vector<size_t> &candidates = context.candidates;
+    candidates.clear();
+    float reach = radius + CircleContactTolerance;
+    segments.GatherNear(from, reach, candidates);
+    size_t numSegments = candidates.size();
+    arcs.GatherNear(from, reach, candidates);
+    for (size_t i = 0; i < candidates.size(); i++)
+        candidates[i] = i < numSegments ? segmentGeoms[candidates[i]] : arcGeoms[candidates[i]];
+    candidates.insert(candidates.end(), otherGeoms.begin(), otherGeoms.end());
+    sort(candidates.begin(), candidates.end());
+
+    bool found = false;
+    for (vector<size_t>::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
+    {
+        if (context.stats.CollisionCircle(geoms[*c], radius, from, to, collideinfo))
+        {
+            hit = geoms[*c];
+            found = true;
+        }
+    }
+    return found;
+}
+
+void SegmentSpace::CollisionCircleBatch(const CircleQueryBatch &batch, ContactBuffer &out) const
+{
+    CollisionCircleBatchPerQuery(batch, out);
+}
+
+}
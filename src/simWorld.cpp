@@ -0,0 +1,344 @@
+#include <cmath>
+#include <cassert>
+
+#include "simWorld.h"
+#include "profiler.h"
+
+SimWorld::SimWorld() : world(bbox2(vector2(400, 300), vector2(400, 300))), map(&world), parallel(0),
+    levelArea(vector2(400, 300), vector2(400, 300)), canSleep(true)
+{
+}
+
+SimWorld::~SimWorld()
+{
+    Clear();
+    delete parallel;
+}
+
+void SimWorld::BuildLevel(unsigned int seed)
+{
+    assert(geoms.empty());
+    world.Reset(bbox2(vector2(400, 300), vector2(400, 300)), 6);
+    world.AddGeom(CreateLineSegment(vector2(0, 500), vector2(800, 500)));
+    world.AddGeom(CreateLineSegment(vector2(10, 0), vector2(10, 500)));
+    world.AddGeom(CreateLineSegment(vector2(790, 0), vector2(790, 500)));
+
+    world.AddGeom(CreateLineSegment(vector2(550, 0), vector2(550, 400)));
+    world.AddGeom(CreateLineSegment(vector2(600, 0), vector2(600, 400)));
+
+    world.AddGeom(CreateLineSegment(vector2(20, 400), vector2(100, 450)));
+    world.AddGeom(CreateLineSegment(vector2(100, 400), vector2(20, 450)));
+    // between the walls, above the floor
+    levelArea.set(vector2(400, 250), vector2(380, 250));
+
+    LevelParams params;
+    params.seed = seed;
+    AddGenerated(params);
+    AddPlatforms(3, seed);
+}
+
+void SimWorld::BuildLevel(const LevelParams &params)
+{
+    assert(geoms.empty());
+    // leaves of about 16 geoms
+    int depth = 1;
+    while (depth < 12 && (size_t(1) << (2 * depth)) * 16 < params.GetGeomCount())
+        depth++;
+    bbox2 area = params.area;
+    area.set(area.center(), area.extents() + vector2(params.maxSize, params.maxSize));
+    world.Reset(area, depth);
+    levelArea = params.area;
+    AddGenerated(params);
+}
+
+void SimWorld::AddGenerated(const LevelParams &params)
+{
+    size_t first = geoms.size();
+    GenerateLevel(params, geoms);
+    for (size_t i = first; i < geoms.size(); i++)
+        world.AddGeom(geoms[i]);
+    while (world.Update())
+        ;
+}
+
+void SimWorld::AddPlatforms(size_t count, unsigned int seed)
+{
+    const float pi = 3.14159265f;
+    LevelRandom random(seed * 2654435761u + unsigned(platforms.size()));
+    for (size_t i = 0; i < count; i++)
+    {
+        Platform p;
+        float halfWidth = random.Uniform(30, 60);
+        p.from.set(random.Uniform(levelArea.vmin.x + halfWidth, levelArea.vmax.x - halfWidth),
+            random.Uniform(levelArea.vmin.y, levelArea.vmax.y));
+        // sideways, up and down or diagonal
+        p.dir.set(1, 0);
+        p.dir.rotate(float(random.Next() % 4) * 0.25f * pi);
+        p.length = random.Uniform(100, 300);
+        vector2 to = p.from + p.dir * p.length;
+        if (to.x < levelArea.vmin.x || to.x > levelArea.vmax.x || to.y < levelArea.vmin.y || to.y > levelArea.vmax.y)
+            p.dir = -p.dir;
+        p.travelled = 0;
+        p.speed = random.Uniform(40, 120);
+        p.listed = false;
+
+        p.body = new Phy2d::RigidBody;
+        p.body->SetPosition(p.from);
+        Phy2d::GeomPtr segment = CreateLineSegment(p.from - vector2(halfWidth, 0), p.from + vector2(halfWidth, 0));
+        p.body->AddGeom(segment);
+        world.AddGeom(segment);
+        p.lastBox = p.body->GetBBox();
+        platforms.push_back(p);
+    }
+}
+
+void SimWorld::Clear()
+{
+    movers.Clear();
+    crowd.Clear();
+    world.Clear();
+    for (vector<Platform>::iterator p = platforms.begin(); p != platforms.end(); ++p)
+        delete p->body;
+    platforms.clear();
+    movedPlatforms.clear();
+    for (vector<Phy2d::GeomPtr>::iterator g = geoms.begin(); g != geoms.end(); ++g)
+        delete *g;
+    geoms.clear();
+}
+
+void SimWorld::AddMover(MoveObject *object)
+{
+    object->SetMapQuery(&map);
+    object->SetCanSleep(canSleep);
+    movers.Add(object);
+}
+
+void SimWorld::AddCrowd(size_t count, unsigned int seed)
+{
+    const float radius = 20.0f;   // of CharSim
+    const float spacing = radius * 2.5f;
+    int columns = max(1, int((levelArea.vmax.x - levelArea.vmin.x) / spacing));
+    int rows = max(1, int((levelArea.vmax.y - levelArea.vmin.y) / spacing));
+    vector<vector2> spots;
+    for (int row = 0; row < rows; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            vector2 pos(levelArea.vmin.x + spacing * (column + 0.5f), levelArea.vmin.y + spacing * (row + 0.5f));
+            if (IsClear(pos, radius))
+                spots.push_back(pos);
+        }
+    }
+    if (spots.empty())
+        spots.push_back(levelArea.center());
+    for (size_t i = 0; i < count; i++)
+    {
+        // the members put on a spot again are pushed apart by the crowd's Separate
+        size_t n = crowd.GetCount();
+        crowd.Add(spots[n % spots.size()], radius, seed * 7919u + unsigned(n));
+    }
+}
+
+bool SimWorld::IsClear(const vector2 &pos, float radius) const
+{
+    bbox2 box(pos, vector2(radius, radius));
+    for (vector<Phy2d::GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
+    {
+        vector2 shadow;
+        if (Phy2d::BoxOverlap((*g)->GetBBox(), box) && (*g)->GetDistanceSquared(pos, shadow) <= radius * radius)
+            return false;
+    }
+    return true;
+}
+
+void SimWorld::SetNumThreads(int numThreads)
+{
+    if (numThreads == 0)
+        numThreads = Phy2d::ParallelQuery::GetNumCores();
+    if (numThreads == 1)
+    {
+        delete parallel;
+        parallel = 0;
+    }
+    else if (parallel)
+        parallel->SetNumThreads(numThreads);
+    else
+        parallel = new Phy2d::ParallelQuery(numThreads);
+    crowd.SetParallel(parallel);
+}
+
+void SimWorld::SetCanSleep(bool canSleep)
+{
+    this->canSleep = canSleep;
+    for (int i = 0; i < movers.GetProxyCount(); i++)
+    {
+        if (MoveObject *object = movers.GetObject(i))
+            object->SetCanSleep(canSleep);
+    }
+    crowd.SetCanSleep(canSleep);
+}
+
+Phy2d::LineSegmentGeom *SimWorld::CreateLineSegment(const vector2 &a, const vector2 &b)
+{
+    Phy2d::LineSegmentGeom *lsg = new Phy2d::LineSegmentGeom;
+    lsg->SetLineSegment(a, b);
+    geoms.push_back(lsg);
+    return lsg;
+}
+
+void SimWorld::Step(float delta)
+{
+    PROFILE_ZONE("SimWorld::Step");
+    MoveBodies(delta);
+    UpdateSpace();
+    SavePositions();
+    RunMovers(delta);
+    UpdateMovers();
+    StepCrowd(delta);
+}
+
+void SimWorld::MoveBodies(float delta)
+{
+    for (size_t i = 0; i < platforms.size(); i++)
+    {
+        Platform &p = platforms[i];
+        assert(fabs(p.speed * delta) <= p.length);
+        // turn around at the ends
+        float t = p.travelled + p.speed * delta;
+        if (t > p.length)
+        {
+            t = 2 * p.length - t;
+            p.speed = -p.speed;
+        }
+        else if (t < 0)
+        {
+            t = -t;
+            p.speed = -p.speed;
+        }
+        p.travelled = t;
+        if (p.body->MoveTo(p.from + p.dir * t, delta) && !p.listed)
+        {
+            p.listed = true;
+            movedPlatforms.push_back(i);
+        }
+    }
+}
+
+void SimWorld::UpdateSpace()
+{
+    PROFILE_ZONE("Space::Update");
+    wakeAreas.clear();
+    for (vector<size_t>::iterator i = movedPlatforms.begin(); i != movedPlatforms.end(); ++i)
+    {
+        Platform &p = platforms[*i];
+        bbox2 area = p.lastBox;
+        area.extend(p.body->GetBBox());
+        wakeAreas.push_back(area);
+        p.lastBox = p.body->GetBBox();
+        p.listed = false;
+    }
+    movedPlatforms.clear();
+    if (!wakeAreas.empty())
+        Wake(wakeAreas);
+    world.Update();
+}
+
+void SimWorld::Wake(const vector<bbox2> &areas)
+{
+    for (int i = 0; i < movers.GetProxyCount(); i++)
+    {
+        MoveObject *object = movers.GetObject(i);
+        if (!object || !object->IsSleeping())
+            continue;
+        bbox2 box(object->GetPosition(), vector2(object->GetRadius(), object->GetRadius()));
+        for (vector<bbox2>::const_iterator area = areas.begin(); area != areas.end(); ++area)
+        {
+            if (Phy2d::BoxOverlap(*area, box))
+            {
+                object->Wake();
+                break;
+            }
+        }
+    }
+    crowd.Wake(&areas[0], areas.size());
+}
+
+void SimWorld::SavePositions()
+{
+    for (int i = 0; i < movers.GetProxyCount(); i++)
+    {
+        if (MoveObject *object = movers.GetObject(i))
+            object->SavePosition();
+    }
+}
+
+void SimWorld::RunMovers(float delta)
+{
+    PROFILE_ZONE("SimWorld::RunMovers");
+    for (int i = 0; i < movers.GetProxyCount(); i++)
+    {
+        if (MoveObject *object = movers.GetObject(i))
+            object->OnFrame(delta);
+    }
+}
+
+void SimWorld::UpdateMovers()
+{
+    PROFILE_ZONE("SimWorld::UpdateMovers");
+    movers.Update();
+    ResolvePushes();
+}
+
+void SimWorld::StepCrowd(float delta)
+{
+    crowd.Step(delta, world);
+}
+
+void SimWorld::ResolvePushes()
+{
+    const SweepAndPrune::PairSet &pairs = movers.GetPairs();
+    for (SweepAndPrune::PairSet::const_iterator p = pairs.begin(); p != pairs.end(); ++p)
+    {
+        MoveObject *a = movers.GetObject(p->a);
+        MoveObject *b = movers.GetObject(p->b);
+        vector2 n = b->GetPosition() - a->GetPosition();
+        float dist = n.len();
+        float overlap = a->GetRadius() + b->GetRadius() - dist;
+        if (overlap <= 0)
+            continue;
+        if (dist > TINY)
+            n /= dist;
+        else
+            n.set(1, 0);
+        a->Push(n * (-0.5f * overlap));
+        b->Push(n * (0.5f * overlap));
+
+        // cancel the approaching part of the velocities, shared equally
+        float vn = dot_product(b->GetVelocity() - a->GetVelocity(), n);
+        if (vn < 0)
+        {
+            a->SetVelocity(a->GetVelocity() + n * (vn * 0.5f));
+            b->SetVelocity(b->GetVelocity() - n * (vn * 0.5f));
+        }
+    }
+}
+
+unsigned int SimWorld::HashWorld() const
+{
+    PROFILE_ZONE("SimWorld::HashWorld");
+    Phy2d::StateHash hash;
+    for (vector<Phy2d::GeomPtr>::const_iterator g = geoms.begin(); g != geoms.end(); ++g)
+        hash.Add(**g);
+    for (vector<Platform>::const_iterator p = platforms.begin(); p != platforms.end(); ++p)
+    {
+        p->body->HashState(hash);
+        hash.Add(p->travelled);
+    }
+    for (int i = 0; i < movers.GetProxyCount(); i++)
+    {
+        if (MoveObject *object = movers.GetObject(i))
+            object->HashState(hash);
+    }
+    crowd.HashState(hash);
+    return hash.Get();
+}
@@ -0,0 +1,167 @@
+#include <cassert>
+#include "sweepAndPrune.h"
+
+void SweepAndPrune::SetBounds(Proxy &proxy)
+{
+    const vector2 &p = proxy.object->GetPosition();
+    float r = proxy.object->GetRadius() + margin;
+    proxy.lo[0] = p.x - r;
+    proxy.hi[0] = p.x + r;
+    proxy.lo[1] = p.y - r;
+    proxy.hi[1] = p.y + r;
+}
+
+bool SweepAndPrune::Overlap(int a, int b) const
+{
+    const Proxy &pa = proxies[a];
+    const Proxy &pb = proxies[b];
+    return pa.lo[0] <= pb.hi[0] && pb.lo[0] <= pa.hi[0] &&
+           pa.lo[1] <= pb.hi[1] && pb.lo[1] <= pa.hi[1];
+}
+
+int SweepAndPrune::Add(MoveObject *object)
+{
+    assert(object);
+    int id;
+    if (!freeProxies.empty())
+    {
+        id = freeProxies.back();
+        freeProxies.pop_back();
+    }
+    else
+    {
+        id = int(proxies.size());
+        proxies.push_back(Proxy());
+    }
+    Proxy &proxy = proxies[id];
+    proxy.object = object;
+    SetBounds(proxy);
+
+    // appended behind everything, as if far away; sorting it in reports its pairs
+    for (int axis = 0; axis < 2; axis++)
+    {
+        EndPoint e;
+        e.proxy = id;
+        e.isBegin = true;
+        e.value = proxy.lo[axis];
+        endPoints[axis].push_back(e);
+        e.isBegin = false;
+        e.value = proxy.hi[axis];
+        endPoints[axis].push_back(e);
+        SortAxis(axis);
+    }
+    return id;
+}
+
+void SweepAndPrune::Remove(MoveObject *object)
+{
+    int id = -1;
+    for (size_t i = 0; i < proxies.size(); i++)
+    {
+        if (proxies[i].object == object)
+        {
+            id = int(i);
+            break;
+        }
+    }
+    if (id < 0)
+        return;
+
+    for (PairSet::iterator p = pairs.begin(); p != pairs.end();)
+    {
+        if (p->a == id || p->b == id)
+        {
+            if (listener)
+                listener->OnPairRemoved(proxies[p->a].object, proxies[p->b].object);
+            pairs.erase(p++);
+        }
+        else
+            ++p;
+    }
+    for (int axis = 0; axis < 2; axis++)
+    {
+        vector<EndPoint> &list = endPoints[axis];
+        size_t n = 0;
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            if (list[i].proxy != id)
+                list[n++] = list[i];
+        }
+        list.resize(n);
+    }
+    proxies[id].object = 0;
+    freeProxies.push_back(id);
+}
+
+void SweepAndPrune::Clear()
+{
+    proxies.clear();
+    freeProxies.clear();
+    endPoints[0].clear();
+    endPoints[1].clear();
+    pairs.clear();
+}
+
+void SweepAndPrune::Update()
+{
+    for (vector<Proxy>::iterator p = proxies.begin(); p != proxies.end(); ++p)
+    {
+        if (p->object)
+            SetBounds(*p);
+    }
+    for (int axis = 0; axis < 2; axis++)
+    {
+        vector<EndPoint> &list = endPoints[axis];
+        for (vector<EndPoint>::iterator e = list.begin(); e != list.end(); ++e)
+        {
+            const Proxy &p = proxies[e->proxy];
+            e->value = e->isBegin ? p.lo[axis] : p.hi[axis];
+        }
+        SortAxis(axis);
+    }
+}
+
+/// insertion sort, nearly sorted from the last frame
+void SweepAndPrune::SortAxis(int axis)
+{
+    vector<EndPoint> &list = endPoints[axis];
+    for (size_t i = 1; i < list.size(); i++)
+    {
+        EndPoint key = list[i];
+        size_t j = i;
+        while (j > 0 && list[j - 1].value > key.value)
+        {
+            const EndPoint &passed = list[j - 1];
+            if (key.isBegin && !passed.isBegin)
+            {
+                // begin moved over an end: they overlap on this axis now
+                if (Overlap(key.proxy, passed.proxy))
+                    AddPair(key.proxy, passed.proxy);
+            }
+            else if (!key.isBegin && passed.isBegin)
+            {
+                // end moved over a begin: they are apart on this axis now
+                RemovePair(key.proxy, passed.proxy);
+            }
+            list[j] = passed;
+            j--;
+        }
+        list[j] = key;
+    }
+}
+
+void SweepAndPrune::AddPair(int a, int b)
+{
+    if (a == b)
+        return;
+    if (pairs.insert(Pair(a, b)).second && listener)
+        listener->OnPairAdded(proxies[a].object, proxies[b].object);
+}
+
+void SweepAndPrune::RemovePair(int a, int b)
+{
+    if (a == b)
+        return;
+    if (pairs.erase(Pair(a, b)) && listener)
+        listener->OnPairRemoved(proxies[a].object, proxies[b].object);
+}
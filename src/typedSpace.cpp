@@ -0,0 +1,51 @@
+#include <cassert>
+#include "typedSpace.h"
+
+namespace Phy2d
+{
+GeomPtr SortHitsByGeom(const vector<GeomPtr> &geoms, QueryContext &context, ContactSink &collideinfo)
+{
+    vector<size_t> &hits = context.candidates;
+    const vector<CollisionInfo> &contacts = context.contacts;
+    assert(hits.size() % 2 == 0);
+    size_t numHits = hits.size() / 2;
+    if (numHits == 0)
+        return 0;
+
+    bool sorted = true;
+    for (size_t i = 1; i < numHits && sorted; i++)
+        sorted = hits[i * 2 - 2] < hits[i * 2];
+    if (!sorted)
+    {
+        // few geoms hit at once, an insertion sort over (index, begin, end) will do.
+        // spread the pairs out to triples, back to front so nothing is overwritten before it is read
+        hits.resize(numHits * 3);
+        for (size_t i = numHits; i-- > 0;)
+        {
+            size_t end = hits[i * 2 + 1];
+            size_t begin = i > 0 ? hits[i * 2 - 1] : 0;
+            hits[i * 3 + 2] = end;
+            hits[i * 3 + 1] = begin;
+            hits[i * 3] = hits[i * 2];
+        }
+        for (size_t i = 1; i < numHits; i++)
+        {
+            for (size_t j = i; j > 0 && hits[j * 3 - 3] > hits[j * 3]; j--)
+            {
+                for (int k = 0; k < 3; k++)
+                    swap(hits[j * 3 - 3 + k], hits[j * 3 + k]);
+            }
+        }
+        for (size_t i = 0; i < numHits; i++)
+        {
+            for (size_t c = hits[i * 3 + 1]; c < hits[i * 3 + 2]; c++)
+                collideinfo.AddContact(contacts[c]);
+        }
+        return geoms[hits[numHits * 3 - 3]];
+    }
+    for (vector<CollisionInfo>::const_iterator c = contacts.begin(); c != contacts.end(); ++c)
+        collideinfo.AddContact(*c);
+    return geoms[hits[numHits * 2 - 2]];
+}
+
+}
@@ -0,0 +1,465 @@
+/*
+Microbenchmarks of the Phy2d primitives and of Space::CollisionCircle on
+every space, printed as CSV (default) or JSON, one row per case.
+
+    bench [-format csv|json] [-min-time seconds] [-max-geoms n] [-seed n]
+          [-bench name] [-space name]
+
+The geoms sit in a grid of cells, one per cell, a segment or an arc around
+the cell's center. A hitting query goes through its geom, a missing one
+runs along the cell borders, which no geom comes near, so the hit ratio of
+a case is exactly the one asked for (the hit_fraction column shows what
+was measured). The primitives are called through Geom pointers, the way
+the spaces call them. Each case runs in ever longer rounds until it took
+-min-time seconds and reports the time per call.
+*/
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "phy2d.h"
+#include "quadTreeSpace.h"
+#include "gridSpace.h"
+#include "bvhSpace.h"
+#include "dynamicTreeSpace.h"
+#include "segmentSpace.h"
+#include "typedSpace.h"
+#include "timer.h"
+
+using namespace std;
+using namespace Phy2d;
+
+namespace
+{
+    enum
+    {
+        CellSize = 16,      // geoms keep 3 units away from the cell borders
+        NumQueries = 65536, // queries of a case, at random geoms
+    };
+    const float GeomRadius = 5;     // half the length of a segment, radius of an arc
+    const float QueryRadius = 2;
+
+    /// small generator of our own, the same numbers on every platform
+    class Random
+    {
+    public:
+        explicit Random(unsigned int seed) : state(seed)
+        {
+        }
+        unsigned int Next()
+        {
+            state = state * 1664525u + 1013904223u;
+            return state >> 8;
+        }
+        /// in [0, 1)
+        float Uniform()
+        {
+            return Next() / 16777216.0f;
+        }
+    protected:
+        unsigned int state;
+    };
+
+    /// a query on one geom
+    struct Query
+    {
+        GeomPtr geom;
+        vector2 circleFrom, circleTo;
+        vector2 rayFrom, rayTo;
+    };
+
+    /// the geoms in their cells, and a hitting query for each
+    class Scene
+    {
+    public:
+        ~Scene()
+        {
+            Clear();
+        }
+        void Build(size_t count, float arcFraction, unsigned int seed)
+        {
+            Clear();
+            Random random(seed);
+            side = size_t(ceil(sqrt(double(count))));
+            for (size_t k = 0; k < count; k++)
+            {
+                vector2 c = (vector2(float(k % side), float(k / side)) + vector2(0.5f, 0.5f)) * float(CellSize);
+                float angle = random.Uniform() * 6.2831853f;
+                vector2 dir(cos(angle), sin(angle));
+                Query hit;
+                if (random.Uniform() < arcFraction)
+                {
+                    ArcGeom *arc = new ArcGeom;
+                    arc->SetArc(c, c + dir * GeomRadius, 0.5f + random.Uniform() * 2.0f);
+                    hit.geom = arc;
+                    // toward the middle of the arc
+                    hit.circleFrom = c + dir * (GeomRadius - 1.5f);
+                    hit.circleTo = c + dir * GeomRadius;
+                    hit.rayFrom = c;
+                    hit.rayTo = c + dir * (GeomRadius + 2);
+                }
+                else
+                {
+                    LineSegmentGeom *segment = new LineSegmentGeom;
+                    segment->SetLineSegment(c - dir * GeomRadius, c + dir * GeomRadius);
+                    hit.geom = segment;
+                    // across the middle of the segment
+                    vector2 normal(-dir.y, dir.x);
+                    hit.circleFrom = c + normal * 1.5f;
+                    hit.circleTo = c - normal;
+                    hit.rayFrom = c + normal * 6.0f;
+                    hit.rayTo = c - normal * 6.0f;
+                }
+                geoms.push_back(hit.geom);
+                hits.push_back(hit);
+            }
+        }
+        void Clear()
+        {
+            for (size_t i = 0; i < geoms.size(); i++)
+                delete geoms[i];
+            geoms.clear();
+            hits.clear();
+        }
+        /// NumQueries queries at random geoms, a fraction 'hitRatio' of them hitting
+        void MakeQueries(float hitRatio, unsigned int seed, vector<Query> &out) const
+        {
+            Random random(seed);
+            out.resize(NumQueries);
+            for (size_t i = 0; i < out.size(); i++)
+            {
+                size_t k = random.Next() % geoms.size();
+                if (random.Uniform() < hitRatio)
+                {
+                    out[i] = hits[k];
+                    continue;
+                }
+                // along the borders of the geom's cell
+                vector2 corner = vector2(float(k % side), float(k / side)) * float(CellSize);
+                out[i].geom = geoms[k];
+                out[i].circleFrom = corner;
+                out[i].circleTo = corner + vector2(0.5f, 0.5f);
+                out[i].rayFrom = corner;
+                out[i].rayTo = corner + vector2(float(CellSize), 0);
+            }
+        }
+        /// the area covered by the cells
+        bbox2 GetArea() const
+        {
+            vector2 extents = vector2(float(side), float(side)) * (CellSize * 0.5f);
+            return bbox2(extents, extents);
+        }
+
+        vector<GeomPtr> geoms;
+    protected:
+        vector<Query> hits;
+        size_t side;
+    };
+
+    // one call of what is measured on query i, counting the hits
+    struct DistanceOp
+    {
+        const vector<Query> *queries;
+        size_t hits;
+        float sum;
+        void operator()(size_t i)
+        {
+            const Query &q = (*queries)[i];
+            vector2 shadow;
+            float d = q.geom->GetDistance(q.circleFrom, shadow);
+            sum += d;
+            hits += d <= QueryRadius;
+        }
+    };
+    struct RayOp
+    {
+        const vector<Query> *queries;
+        size_t hits;
+        CollisionInfo contacts[16];
+        void operator()(size_t i)
+        {
+            const Query &q = (*queries)[i];
+            ContactArray sink(contacts, 16);
+            hits += q.geom->CollisionRay(q.rayFrom, q.rayTo, sink);
+        }
+    };
+    struct CircleOp
+    {
+        const vector<Query> *queries;
+        size_t hits;
+        CollisionInfo contacts[16];
+        void operator()(size_t i)
+        {
+            const Query &q = (*queries)[i];
+            ContactArray sink(contacts, 16);
+            hits += q.geom->CollisionCircle(QueryRadius, q.circleFrom, q.circleTo, sink);
+        }
+    };
+    struct SpaceCircleOp
+    {
+        const vector<Query> *queries;
+        size_t hits;
+        Space *space;
+        vector<CollisionInfo> contacts;
+        void operator()(size_t i)
+        {
+            const Query &q = (*queries)[i];
+            contacts.clear();
+            hits += space->CollisionCircle(QueryRadius, q.circleFrom, q.circleTo, contacts);
+        }
+    };
+
+    /// call op in rounds of doubling size until 'minTime' passed, return ns per call.
+    /// A first untimed round warms the caches
+    template <class Op>
+    double Measure(Op &op, size_t count, double minTime, size_t &calls)
+    {
+        for (size_t i = 0; i < count && i < 1024; i++)
+            op(i);
+        op.hits = 0;
+        double elapsed = 0;
+        size_t next = 0;
+        calls = 0;
+        for (size_t round = 1; ; round *= 2)
+        {
+            double start = GetSeconds();
+            for (size_t i = 0; i < round; i++)
+            {
+                op(next);
+                if (++next == count)
+                    next = 0;
+            }
+            elapsed += GetSeconds() - start;
+            calls += round;
+            if (elapsed >= minTime)
+                break;
+        }
+        return elapsed * 1e9 / calls;
+    }
+
+    struct Options
+    {
+        bool json;
+        double minTime;
+        size_t maxGeoms;
+        unsigned int seed;
+        const char *bench;  // run only these, 0 for all
+        const char *space;
+    };
+
+    /// false for an unknown option
+    bool ParseOption(const char *name, const char *value, Options &options)
+    {
+        if (strcmp(name, "-format") == 0 && (strcmp(value, "csv") == 0 || strcmp(value, "json") == 0))
+            options.json = strcmp(value, "json") == 0;
+        else if (strcmp(name, "-min-time") == 0)
+            options.minTime = atof(value);
+        else if (strcmp(name, "-max-geoms") == 0)
+            options.maxGeoms = size_t(atol(value));
+        else if (strcmp(name, "-seed") == 0)
+            options.seed = unsigned(atoi(value));
+        else if (strcmp(name, "-bench") == 0)
+            options.bench = value;
+        else if (strcmp(name, "-space") == 0)
+            options.space = value;
+        else
+            return false;
+        return true;
+    }
+
+    class Report
+    {
+    public:
+        explicit Report(bool json) : json(json), rows(0)
+        {
+            if (json)
+                printf("{\n  \"results\": [\n");
+            else
+                printf("bench,space,geoms,arc_fraction,hit_ratio,calls,ns_per_call,hit_fraction\n");
+        }
+        ~Report()
+        {
+            if (json)
+                printf("\n  ]\n}\n");
+        }
+        void Row(const char *bench, const char *space, size_t geoms, float arcFraction, float hitRatio,
+            size_t calls, double ns, double hitFraction)
+        {
+            if (json)
+            {
+                printf("%s    {\"bench\": \"%s\", \"space\": \"%s\", \"geoms\": %lu, \"arc_fraction\": %g, "
+                    "\"hit_ratio\": %g, \"calls\": %lu, \"ns_per_call\": %.3f, \"hit_fraction\": %.4f}",
+                    rows > 0 ? ",\n" : "", bench, space, (unsigned long)geoms, arcFraction, hitRatio,
+                    (unsigned long)calls, ns, hitFraction);
+            }
+            else
+            {
+                printf("%s,%s,%lu,%g,%g,%lu,%.3f,%.4f\n", bench, space, (unsigned long)geoms, arcFraction, hitRatio,
+                    (unsigned long)calls, ns, hitFraction);
+            }
+            rows++;
+            fflush(stdout);
+        }
+    protected:
+        bool json;
+        size_t rows;
+    };
+
+    bool Selected(const char *filter, const char *name)
+    {
+        return !filter || strcmp(filter, name) == 0;
+    }
+
+    template <class Op>
+    void RunPrimitive(const char *name, Op &op, const vector<Query> &queries, size_t geoms, float arcFraction,
+        float hitRatio, const Options &options, Report &report)
+    {
+        op.queries = &queries;
+        op.hits = 0;
+        size_t calls;
+        double ns = Measure(op, queries.size(), options.minTime, calls);
+        report.Row(name, "-", geoms, arcFraction, hitRatio, calls, ns, double(op.hits) / calls);
+    }
+
+    void RunSpace(const char *name, Space &space, const Scene &scene, const vector<Query> &queries,
+        float arcFraction, float hitRatio, const Options &options, Report &report)
+    {
+        SpaceCircleOp op;
+        op.queries = &queries;
+        op.hits = 0;
+        op.space = &space;
+        size_t calls;
+        double ns = Measure(op, queries.size(), options.minTime, calls);
+        report.Row("Space::CollisionCircle", name, scene.geoms.size(), arcFraction, hitRatio, calls, ns,
+            double(op.hits) / calls);
+    }
+
+    /// fill 'space' with the scene, run the circle queries on it, empty it again
+    void BenchSpace(const char *name, Space &space, const Scene &scene, const vector<vector<Query> > &queries,
+        const float *hitRatios, float arcFraction, const Options &options, Report &report)
+    {
+        if (!Selected(options.space, name))
+            return;
+        for (size_t i = 0; i < scene.geoms.size(); i++)
+            space.AddGeom(scene.geoms[i]);
+        while (space.Update())
+            ;
+        for (size_t h = 0; h < queries.size(); h++)
+            RunSpace(name, space, scene, queries[h], arcFraction, hitRatios[h], options, report);
+        space.Clear();
+    }
+
+    int QuadTreeDepth(size_t geoms)
+    {
+        // leaves of about 16 geoms
+        int depth = 1;
+        while (depth < 12 && (size_t(1) << (2 * depth)) * 16 < geoms)
+            depth++;
+        return depth;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    options.json = false;
+    options.minTime = 0.05;
+    options.maxGeoms = 1000000;
+    options.seed = 1;
+    options.bench = 0;
+    options.space = 0;
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 == argc || !ParseOption(argv[i], argv[i + 1], options))
+        {
+            fprintf(stderr, "usage: %s [-format csv|json] [-min-time seconds] [-max-geoms n] [-seed n]"
+                " [-bench name] [-space name]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const float hitRatios[] = { 0.0f, 0.5f, 1.0f };
+    const size_t numHitRatios = sizeof(hitRatios) / sizeof(hitRatios[0]);
+    const float arcFractions[] = { 0.0f, 0.5f, 1.0f };
+    const size_t numArcFractions = sizeof(arcFractions) / sizeof(arcFractions[0]);
+
+    Report report(options.json);
+    Scene scene;
+    vector<vector<Query> > queries(numHitRatios);
+    for (size_t geoms = 10; geoms <= options.maxGeoms; geoms *= 10)
+    {
+        // the primitives, on scenes of segments only and of arcs only
+        for (int arcs = 0; arcs < 2 && !options.space; arcs++)
+        {
+            const char *ray = arcs ? "ArcGeom::CollisionRay" : "LineSegmentGeom::CollisionRay";
+            const char *other = arcs ? "ArcGeom::CollisionCircle" : "LineSegmentGeom::GetDistance";
+            if (!Selected(options.bench, ray) && !Selected(options.bench, other))
+                continue;
+            float arcFraction = float(arcs);
+            scene.Build(geoms, arcFraction, options.seed);
+            if (!arcs && Selected(options.bench, other))
+            {
+                // a distance is no hit or miss, half the points are next to the segments
+                scene.MakeQueries(0.5f, options.seed, queries[0]);
+                DistanceOp op;
+                op.sum = 0;
+                RunPrimitive(other, op, queries[0], geoms, arcFraction, 0.5f, options, report);
+            }
+            for (size_t h = 0; h < numHitRatios; h++)
+            {
+                scene.MakeQueries(hitRatios[h], options.seed + unsigned(h), queries[h]);
+                if (Selected(options.bench, ray))
+                {
+                    RayOp op;
+                    RunPrimitive(ray, op, queries[h], geoms, arcFraction, hitRatios[h], options, report);
+                }
+                if (arcs && Selected(options.bench, other))
+                {
+                    CircleOp op;
+                    RunPrimitive(other, op, queries[h], geoms, arcFraction, hitRatios[h], options, report);
+                }
+            }
+        }
+
+        if (!Selected(options.bench, "Space::CollisionCircle"))
+            continue;
+        for (size_t a = 0; a < numArcFractions; a++)
+        {
+            scene.Build(geoms, arcFractions[a], options.seed);
+            for (size_t h = 0; h < numHitRatios; h++)
+                scene.MakeQueries(hitRatios[h], options.seed + unsigned(h), queries[h]);
+
+            {
+                Space space;
+                BenchSpace("linear", space, scene, queries, hitRatios, arcFractions[a], options, report);
+            }
+            {
+                QuadTreeSpace space(scene.GetArea(), QuadTreeDepth(geoms));
+                BenchSpace("quadtree", space, scene, queries, hitRatios, arcFractions[a], options, report);
+            }
+            {
+                GridSpace space(scene.GetArea(), float(CellSize));
+                BenchSpace("grid", space, scene, queries, hitRatios, arcFractions[a], options, report);
+            }
+            {
+                BVHSpace space;
+                BenchSpace("bvh", space, scene, queries, hitRatios, arcFractions[a], options, report);
+            }
+            {
+                DynamicTreeSpace space;
+                BenchSpace("dynamictree", space, scene, queries, hitRatios, arcFractions[a], options, report);
+            }
+            {
+                SegmentSpace space;
+                BenchSpace("segment", space, scene, queries, hitRatios, arcFractions[a], options, report);
+            }
+            {
+                LevelSpace space;
+                BenchSpace("typed", space, scene, queries, hitRatios, arcFractions[a], options, report);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,273 @@
+/*
+Runs the simulation without the engine: builds the level like
+MainGameState::OnEnter, drives N CharSims with scripted buttons for M ticks
+and prints the ticks per second, the time of every stage of a step and the
+final state hash.
+
+    headless [-n entities] [-t ticks] [-r tick rate] [-s seed]
+             [-geoms n] [-arcs fraction] [-density d] [-clusters n] [-spanning n] [-nests n]
+             [-crowd n] [-threads n] [-sleep 0|1] [-platforms n] [-trace path]
+
+-geoms replaces the game's level by a generated one of n segments and arcs,
+a fraction -arcs of them arcs, d geoms per 100 x 100 units. -clusters,
+-spanning and -nests add clusters, segments across the whole level and sets
+of 8 concentric arcs to it, see LevelParams.
+
+-crowd adds n AI matchmen to the world's MoverStore, -threads runs their
+queries on n threads (0 is one per core); the hash does not depend on it.
+
+-sleep 0 keeps idle entities and crowd members awake, see MoveObject::IsSleeping.
+How many of them sleep at the end is printed with the hash.
+
+-platforms adds n moving platforms to the level, the game's level has 3 of
+its own. The geoms the space had to move to another node over the run are
+printed with the hash, see QuadTreeSpace::GetReinsertedCount.
+
+Builds with PHY2D_STATS (debug builds or premake --profile) also print what
+the space queries of the whole run did, see Phy2d::QueryStats.
+
+-trace writes the profiler zones of the last ticks as Chrome trace-event
+JSON, for builds with PROFILER_ENABLED (debug builds or premake --profile).
+
+Two runs with the same arguments and the same build end with the same hash.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "charSim.h"
+#include "simWorld.h"
+#include "profiler.h"
+#include "timer.h"
+
+using namespace std;
+
+namespace
+{
+    /**
+    Buttons of one entity: every so many ticks it picks a new direction and
+    maybe a jump, from a random generator of its own, so the input depends
+    on the seed and the entity only.
+    */
+    class ScriptedInput : public CharButtons
+    {
+    public:
+        explicit ScriptedInput(unsigned int seed = 1) : state(seed), ticksLeft(0)
+        {
+        }
+        void Tick()
+        {
+            if (ticksLeft-- > 0)
+                return;
+            ticksLeft = int(Next() % 60) + 10;
+            unsigned int r = Next();
+            Set(Left, r % 3 == 0);
+            Set(Right, r % 3 == 1);
+            Set(Jump, (r >> 8) % 4 == 0);
+        }
+    protected:
+        unsigned int Next()
+        {
+            state = state * 1664525u + 1013904223u;
+            return state >> 8;
+        }
+        unsigned int state;
+        int ticksLeft;
+    };
+
+    enum Stage
+    {
+        StageInput,
+        StageSpace,
+        StageMovers,
+        StageBroadphase,
+        StageCrowd,
+        StageHash,
+        NumStages,
+    };
+    const char *stageNames[NumStages] =
+    {
+        "input",
+        "platforms + space",
+        "movers",
+        "broadphase + pushes",
+        "crowd",
+        "state hash",
+    };
+}
+
+#ifdef PHY2D_STATS
+void PrintStats(const char *name, const Phy2d::QueryStats &stats)
+{
+    printf("%s: queries %u, box tests %u, rejected %u, narrow tests %u (segments %u, arcs %u), contacts %u, at most %u per query\n",
+        name, stats.GetQueries(), stats.GetBoxTests(), stats.GetBoxRejects(), stats.GetNarrowTests(),
+        stats.GetNarrowTests(Phy2d::Geom::LineSeg), stats.GetNarrowTests(Phy2d::Geom::Arc),
+        stats.GetContacts(), stats.GetMaxContacts());
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    int numEntities = 16;
+    int numTicks = 6000;
+    float tickRate = 60;
+    unsigned int seed = 1;
+    int numGeoms = 0;
+    float arcFraction = 0.3f;
+    float density = 4;
+    LevelParams level;
+    int crowdSize = 0;
+    int numThreads = 1;
+    int canSleep = 1;
+    int numPlatforms = 0;
+    const char *tracePath = 0;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-n") == 0)
+            numEntities = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-t") == 0)
+            numTicks = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-r") == 0)
+            tickRate = float(atof(argv[i + 1]));
+        else if (strcmp(argv[i], "-s") == 0)
+            seed = unsigned(atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "-geoms") == 0)
+            numGeoms = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-arcs") == 0)
+            arcFraction = float(atof(argv[i + 1]));
+        else if (strcmp(argv[i], "-density") == 0)
+            density = float(atof(argv[i + 1]));
+        else if (strcmp(argv[i], "-clusters") == 0)
+            level.numClusters = size_t(atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "-spanning") == 0)
+            level.numSpanning = size_t(atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "-nests") == 0)
+            level.numNests = size_t(atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "-crowd") == 0)
+            crowdSize = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-threads") == 0)
+            numThreads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-sleep") == 0)
+            canSleep = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-platforms") == 0)
+            numPlatforms = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-trace") == 0)
+            tracePath = argv[i + 1];
+        else
+        {
+            fprintf(stderr, "usage: %s [-n entities] [-t ticks] [-r tick rate] [-s seed]\n"
+                "    [-geoms n] [-arcs fraction] [-density d] [-clusters n] [-spanning n] [-nests n]\n"
+                "    [-crowd n] [-threads n] [-sleep 0|1] [-platforms n] [-trace path]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (numEntities < 0 || numTicks < 0 || tickRate <= 0 || numGeoms < 0 || density <= 0
+        || arcFraction < 0 || arcFraction > 1 || crowdSize < 0 || numThreads < 0
+        || numPlatforms < 0)
+    {
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    SimWorld sim;
+    // the entities start in a row across the top of the level
+    float left = 50, width = 700, top = 100;
+    if (numGeoms > 0)
+    {
+        level.seed = seed;
+        level.numArcs = size_t(numGeoms * arcFraction);
+        level.numSegments = size_t(numGeoms) - level.numArcs;
+        level.maxTilt = 3.14159265f;
+        level.SetDensity(density);
+        sim.BuildLevel(level);
+        left = level.area.vmin.x;
+        width = level.area.vmax.x - left;
+        top = level.area.vmin.y;
+    }
+    else
+        sim.BuildLevel(seed);
+    sim.AddPlatforms(size_t(numPlatforms), seed);
+
+    vector<CharSim> entities(numEntities);
+    vector<ScriptedInput> inputs(numEntities);
+    for (int i = 0; i < numEntities; i++)
+    {
+        inputs[i] = ScriptedInput(seed * 7919u + i);
+        entities[i].Init(vector2(left + width * (i + 0.5f) / numEntities, top));
+        entities[i].SetInput(&inputs[i]);
+        sim.AddMover(&entities[i]);
+    }
+    sim.AddCrowd(size_t(crowdSize), seed);
+    sim.SetNumThreads(numThreads);
+    sim.SetCanSleep(canSleep != 0);
+
+    float stepTime = 1.0f / tickRate;
+    double stageTime[NumStages] = {0};
+    unsigned int hash = sim.HashWorld();
+    Phy2d::QueryStats crowdStats;
+    size_t reinserted = 0;
+    double start = GetSeconds();
+    for (int tick = 0; tick < numTicks; tick++)
+    {
+        PROFILE_NEXT_FRAME();
+        double t0 = GetSeconds();
+        for (int i = 0; i < numEntities; i++)
+            inputs[i].Tick();
+        double t1 = GetSeconds();
+        sim.MoveBodies(stepTime);
+        sim.UpdateSpace();
+        reinserted += sim.GetSpace().GetReinsertedCount();
+        double t2 = GetSeconds();
+        sim.SavePositions();
+        sim.RunMovers(stepTime);
+        double t3 = GetSeconds();
+        sim.UpdateMovers();
+        double t4 = GetSeconds();
+        sim.StepCrowd(stepTime);
+        crowdStats.Add(sim.GetCrowd().GetStats());
+        double t5 = GetSeconds();
+        hash = sim.HashWorld();
+        double t6 = GetSeconds();
+        stageTime[StageInput] += t1 - t0;
+        stageTime[StageSpace] += t2 - t1;
+        stageTime[StageMovers] += t3 - t2;
+        stageTime[StageBroadphase] += t4 - t3;
+        stageTime[StageCrowd] += t5 - t4;
+        stageTime[StageHash] += t6 - t5;
+    }
+    double total = GetSeconds() - start;
+
+    printf("entities %d, crowd %d, ticks %d, tick rate %g, seed %u, geoms %lu\n", numEntities, crowdSize, numTicks,
+        tickRate, seed, (unsigned long)sim.GetGeoms().size());
+    printf("%.3f s, %.0f ticks/s, %.1f x real time\n", total,
+        total > 0 ? numTicks / total : 0.0, total > 0 ? numTicks * stepTime / total : 0.0);
+    for (int s = 0; s < NumStages; s++)
+    {
+        printf("%-20s %9.3f ms %8.2f us/tick\n", stageNames[s], stageTime[s] * 1000,
+            numTicks > 0 ? stageTime[s] * 1e6 / numTicks : 0.0);
+    }
+#ifdef PHY2D_STATS
+    PrintStats("entities", sim.GetSpace().GetStats());
+    PrintStats("crowd", crowdStats);
+#endif
+    int sleeping = 0;
+    for (int i = 0; i < numEntities; i++)
+        sleeping += entities[i].IsSleeping() ? 1 : 0;
+    printf("sleeping: entities %d, crowd %lu\n", sleeping, (unsigned long)sim.GetCrowd().GetSleepingCount());
+    printf("platforms %lu, geoms moved to another node %lu\n", (unsigned long)sim.GetPlatformCount(),
+        (unsigned long)reinserted);
+    printf("hash %08x\n", hash);
+    if (tracePath)
+    {
+#ifdef PROFILER_ENABLED
+        PROFILE_NEXT_FRAME();
+        if (!Profiler::Instance().WriteChromeTrace(tracePath))
+            fprintf(stderr, "can't write %s\n", tracePath);
+#else
+        fprintf(stderr, "-trace needs a build with PROFILER_ENABLED\n");
+#endif
+    }
+    sim.Clear();
+    return 0;
+}